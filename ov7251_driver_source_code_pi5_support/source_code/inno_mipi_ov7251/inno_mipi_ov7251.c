@@ -15,14 +15,26 @@
  */
 
 #include <linux/clk.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
+#include <linux/gpio/consumer.h>
+#include <linux/hrtimer.h>
 #include <linux/i2c.h>
 #include <linux/init.h>
 #include <linux/io.h>
+#include <linux/kthread.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/of.h>
 #include <linux/of_graph.h>
+#include <linux/property.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/videodev2.h>
+#include <linux/workqueue.h>
 #include <media/v4l2-ctrls.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-fwnode.h>
@@ -68,6 +80,13 @@
 #define OV7251_VTS_LOW			0x380f
 #define OV7251_VTS_MIN_OFFSET		92
 #define OV7251_VTS_MAX			0x7fff
+#define OV7251_X_OUTPUT_SIZE_HIGH	0x3808
+#define OV7251_X_OUTPUT_SIZE_LOW	0x3809
+#define OV7251_Y_OUTPUT_SIZE_HIGH	0x380a
+#define OV7251_Y_OUTPUT_SIZE_LOW	0x380b
+/* Subsampling increments, odd step in the high nibble: 0x11 full, 0x31 skip 2, 0x71 skip 4 */
+#define OV7251_X_INC			0x3814
+#define OV7251_Y_INC			0x3815
 #define OV7251_TIMING_FORMAT1		0x3820
 #define OV7251_TIMING_FORMAT1_VFLIP	BIT(2)
 #define OV7251_TIMING_FORMAT2		0x3821
@@ -85,6 +104,69 @@
 #define OV7251_PLL2_SYS_DIV_REG		0x309a
 #define OV7251_PLL2_ADC_DIV_REG		0x309b
 
+/*
+ * Strobe (FREX/ILLUM) output. Offset and width are in exposure lines,
+ * the pulse starts "offset" lines after the start of exposure.
+ * Datasheet not available to confirm the bit layout of the control byte.
+ */
+#define OV7251_STROBE_CTRL		0x3b80
+#define OV7251_STROBE_CTRL_ENABLE	BIT(7)
+#define OV7251_STROBE_CTRL_INVERT	BIT(6)
+#define OV7251_STROBE_OFFSET_HIGH	0x3b8a
+#define OV7251_STROBE_OFFSET_LOW	0x3b8b
+#define OV7251_STROBE_WIDTH_HIGH	0x3b8e
+#define OV7251_STROBE_WIDTH_LOW		0x3b8f
+#define OV7251_STROBE_MAX		0xffff
+
+/*
+ * Group hold. Register writes between start and end of a group are
+ * buffered in one of the sensor's banks and latched at a frame boundary.
+ * With auto switch enabled the sensor alternates between group 0 and 1,
+ * holding each for the programmed number of frames.
+ */
+#define OV7251_GROUP_ACCESS		0x3208
+#define OV7251_GROUP_ACCESS_START	0x00
+#define OV7251_GROUP_ACCESS_END		0x10
+#define OV7251_GROUP_ACCESS_LAUNCH	0xa0
+#define OV7251_GROUP0_FRAMES		0x3209
+#define OV7251_GROUP1_FRAMES		0x320a
+#define OV7251_GROUP_SWITCH		0x320b
+#define OV7251_GROUP_SWITCH_AUTO	BIT(7)
+
+/* Exposure bracketing: (exposure, gain) per bank, 0 = current value */
+#define OV7251_BRACKET_BANKS		2
+
+/*
+ * Frames between setting a control and the first frame that shows it.
+ * Exposure, gain and VBLANK are launched together through group hold
+ * bank 0, so they always land on the same frame boundary; the group is
+ * written from s_ctrl itself, so the count starts at the call. The 2 is
+ * the usual OV7251 figure and has not been measured on the MCU-bridged
+ * module, where each write is followed by a 2 ms settle (reg_write()).
+ */
+#define OV7251_FRAME_CTRL_BANK		0
+#define OV7251_EXPOSURE_DELAY		2
+#define OV7251_GAIN_DELAY		2
+#define OV7251_VBLANK_DELAY		2
+
+/* Control groups waiting to be written by the I2C worker */
+#define OV7251_DIRTY_HFLIP		BIT(0)
+#define OV7251_DIRTY_VFLIP		BIT(1)
+#define OV7251_DIRTY_FRAME		BIT(2)	/* exposure and gain */
+#define OV7251_DIRTY_VBLANK		BIT(3)
+#define OV7251_DIRTY_STROBE		BIT(4)
+#define OV7251_DIRTY_BRACKET		BIT(5)
+#define OV7251_DIRTY_ALL		(OV7251_DIRTY_HFLIP | OV7251_DIRTY_VFLIP | \
+					 OV7251_DIRTY_FRAME | OV7251_DIRTY_VBLANK | \
+					 OV7251_DIRTY_STROBE | OV7251_DIRTY_BRACKET)
+
+/* 16-bit frame counter of the MIPI transmitter, wraps around */
+#define OV7251_FRAME_CNT_HIGH		0x484a
+#define OV7251_FRAME_CNT_LOW		0x484b
+
+/* Folded well before 65536 frames pass, even at 323 fps (~200 s) */
+#define OV7251_COUNTER_POLL_MS		10000
+
 /*
  * OV7251 native and active pixel array size.
  * Datasheet not available to confirm these values, so assume there are no
@@ -99,12 +181,57 @@
 
 #define OV7251_PIXEL_CLOCK 48000000
 
+/*
+ * The MCU sets up the same PLL for every mode and subsampled modes only
+ * read out fewer lines, so all modes share the pixel rate of the VGA
+ * timing (VTS 0x23c x HTS 772 at 120 fps).
+ */
+#define OV7251_PIXEL_RATE		(0x23c * 772 * 120)
+
+/* Sensor modes known to the MCU (register 202), one per depth/trigger pair */
+#define OV7251_MCU_MODES		4
+
+/* Driver private controls */
+#define V4L2_CID_OV7251_BASE		(V4L2_CID_USER_BASE | 0xf000)
+#define V4L2_CID_OV7251_EXT_TRIGGER	(V4L2_CID_OV7251_BASE + 0)
+#define V4L2_CID_OV7251_STROBE_ENABLE	(V4L2_CID_OV7251_BASE + 1)
+#define V4L2_CID_OV7251_STROBE_INVERT	(V4L2_CID_OV7251_BASE + 2)
+#define V4L2_CID_OV7251_STROBE_WIDTH	(V4L2_CID_OV7251_BASE + 3)
+#define V4L2_CID_OV7251_STROBE_OFFSET	(V4L2_CID_OV7251_BASE + 4)
+#define V4L2_CID_OV7251_FRAME_COUNT	(V4L2_CID_OV7251_BASE + 5)
+#define V4L2_CID_OV7251_TRIGGER_COUNT	(V4L2_CID_OV7251_BASE + 6)
+#define V4L2_CID_OV7251_BRACKET		(V4L2_CID_OV7251_BASE + 7)
+#define V4L2_CID_OV7251_BRACKET_BANKS	(V4L2_CID_OV7251_BASE + 8)
+#define V4L2_CID_OV7251_BRACKET_BANK	(V4L2_CID_OV7251_BASE + 9)
+#define V4L2_CID_OV7251_EXPOSURE_DELAY	(V4L2_CID_OV7251_BASE + 10)
+#define V4L2_CID_OV7251_GAIN_DELAY	(V4L2_CID_OV7251_BASE + 11)
+#define V4L2_CID_OV7251_VBLANK_DELAY	(V4L2_CID_OV7251_BASE + 12)
+#define V4L2_CID_OV7251_SKIP_FRAMES	(V4L2_CID_OV7251_BASE + 13)
+#define V4L2_CID_OV7251_TRIGGER_RATE	(V4L2_CID_OV7251_BASE + 14)
+
 
 
 /*Sensor work Mode - default 8-Bit Streaming */
 static int sensor_mode = 1;
 module_param(sensor_mode, int, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-MODULE_PARM_DESC(sensor_mode, "Sensor work Mode: 0=10bit_stream 1=8bit_stream  2=10bit_tigger 3=8bit_tigger  ");
+MODULE_PARM_DESC(sensor_mode, "Default sensor work Mode: 0=10bit_stream 1=8bit_stream  2=10bit_tigger 3=8bit_tigger "
+		 "(overridden per camera by inno,bit-depth / inno,trigger-mode in DT)");
+
+static unsigned int i2c_retries = 3;
+module_param(i2c_retries, uint, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(i2c_retries, "Retries of a failed sensor/MCU I2C transfer (default 3)");
+
+static bool i2c_recover;
+module_param(i2c_recover, bool, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(i2c_recover, "Run I2C bus recovery before retrying a timed out transfer");
+
+static bool force_reset;
+module_param(force_reset, bool, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(force_reset, "Always power down and reprogram the MCU at probe, even if it is already ready in the requested mode");
+
+static bool warm_reload;
+module_param(warm_reload, bool, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(warm_reload, "Keep an idle camera powered after probe and unload, so a driver reload can skip the MCU reset (default off)");
 
 /* Addresses to scan */
 static const unsigned short normal_i2c[] = { 0x60, 0x60 , I2C_CLIENT_END };
@@ -127,6 +254,8 @@ struct ov7251_mode {
 	u32 max_fps;
 	u32 hts_def;
 	u32 vts_def;
+	/* Invalid frames after stream-on, reported by g_skip_frames */
+	u32 skip_frames;
 	const struct ov7251_reg *reg_list;
 };
 
@@ -136,14 +265,36 @@ struct ov7251_mode {
  * mipi_datarate per lane 800Mbps
  */
 static const struct ov7251_reg  ov7251_setting_full_vga_10_183fps[] = {
-	
+	{OV7251_X_OUTPUT_SIZE_HIGH, 0x02}, {OV7251_X_OUTPUT_SIZE_LOW, 0x80},
+	{OV7251_Y_OUTPUT_SIZE_HIGH, 0x01}, {OV7251_Y_OUTPUT_SIZE_LOW, 0xe0},
+	{OV7251_X_INC, 0x11}, {OV7251_Y_INC, 0x11},
 	{OV7251_TABLE_END, 0x00},
 };
 static const struct ov7251_reg ov7251_setting_full_vga_8_183fps[] = {
-	
+	{OV7251_X_OUTPUT_SIZE_HIGH, 0x02}, {OV7251_X_OUTPUT_SIZE_LOW, 0x80},
+	{OV7251_Y_OUTPUT_SIZE_HIGH, 0x01}, {OV7251_Y_OUTPUT_SIZE_LOW, 0xe0},
+	{OV7251_X_INC, 0x11}, {OV7251_Y_INC, 0x11},
         {OV7251_TABLE_END, 0x00},
 };
 
+/*
+ * Subsampled modes, written after the MCU has set up VGA. Skipping keeps
+ * the line time (HTS) but reads out 1/2 or 1/4 of the lines, so the frame
+ * time drops with the height: 206 fps at 320x240, 323 fps at 160x120.
+ */
+static const struct ov7251_reg ov7251_setting_qvga_skip2[] = {
+	{OV7251_X_OUTPUT_SIZE_HIGH, 0x01}, {OV7251_X_OUTPUT_SIZE_LOW, 0x40},
+	{OV7251_Y_OUTPUT_SIZE_HIGH, 0x00}, {OV7251_Y_OUTPUT_SIZE_LOW, 0xf0},
+	{OV7251_X_INC, 0x31}, {OV7251_Y_INC, 0x31},
+	{OV7251_TABLE_END, 0x00},
+};
+static const struct ov7251_reg ov7251_setting_qqvga_skip4[] = {
+	{OV7251_X_OUTPUT_SIZE_HIGH, 0x00}, {OV7251_X_OUTPUT_SIZE_LOW, 0xa0},
+	{OV7251_Y_OUTPUT_SIZE_HIGH, 0x00}, {OV7251_Y_OUTPUT_SIZE_LOW, 0x78},
+	{OV7251_X_INC, 0x71}, {OV7251_Y_INC, 0x71},
+	{OV7251_TABLE_END, 0x00},
+};
+
 
 static const struct ov7251_reg start[] = {
 	{OV7251_SC_MODE_SELECT, OV7251_SC_MODE_SELECT_STREAMING},/* mode select streaming on */
@@ -158,6 +309,76 @@ static const struct ov7251_reg stop[] = {
 
 #define SIZEOF_I2C_TRANSBUF 32
 
+/* First retry waits 100-200 us, doubling each time */
+#define OV7251_I2C_RETRY_US		100
+
+/* Outcome of every sensor/MCU transfer, shown in debugfs */
+struct ov7251_i2c_stats {
+	atomic_t transfers;
+	atomic_t nak;
+	atomic_t timeout;
+	atomic_t arb_lost;
+	atomic_t other;
+	atomic_t retries;
+	atomic_t recovered;	/* succeeded after a retry */
+	atomic_t failed;	/* retries exhausted */
+	atomic_t bus_recoveries;
+	atomic_t ctrl_failed;	/* background control writes that failed */
+};
+
+/*
+ * Trigger generator on an optional "trigger-gpios" line, for trigger
+ * modes without an external pulse source. The rate is in mHz; edges are
+ * aligned to multiples of the period on CLOCK_MONOTONIC, so cameras set
+ * to the same rate fire in phase.
+ */
+#define OV7251_TRIGGER_PULSE_US		100
+#define OV7251_TRIGGER_RATE_MAX		323000
+#define OV7251_TRIGGER_LOG		64
+
+struct ov7251_trigger_edge {
+	u32 seq;		/* trigger index since stream-on */
+	ktime_t time;		/* rising edge, CLOCK_MONOTONIC */
+	s32 late_ns;		/* behind the scheduled time */
+};
+
+struct ov7251_trigger {
+	struct gpio_desc *gpio;
+	struct task_struct *thread;
+	u32 rate;		/* mHz, 0 = off */
+	u64 period_ns;
+	/* Edge log, written by the thread, read from debugfs */
+	spinlock_t log_lock;
+	struct ov7251_trigger_edge log[OV7251_TRIGGER_LOG];
+	u32 seq;
+	u32 skipped;		/* periods missed after falling behind */
+	s32 late_max_ns;
+};
+
+/*
+ * Module power gating through "pwdn-gpios": index 0 powers the module
+ * (sensor and MCU) down, index 1 drives the LED. After power-up the
+ * sensor needs 8192 XCLK cycles before the first SCCB access; the MCU
+ * is then polled until it answers instead of sleeping a fixed boot time.
+ * The minimum off time lets the rails discharge on a quick stop/start.
+ */
+#define OV7251_POWERON_MIN_US		DIV_ROUND_UP(8192 * 1000, 24000)
+#define OV7251_POWEROFF_MIN_US		10000
+#define OV7251_MCU_BOOT_POLL_US		1000
+#define OV7251_MCU_BOOT_TIMEOUT_US	500000
+
+struct ov7251_power {
+	struct gpio_desc *pwdn;
+	struct gpio_desc *led;
+	bool on;
+	ktime_t on_time;
+	ktime_t off_time;
+	u32 cycles;
+	s64 boot_us;		/* power on to MCU answering */
+	s64 wake_us;		/* power on to stream-on */
+	s64 wake_max_us;
+};
+
 struct inno_rom_table {
 	char magic[12];
 	char manuf[32];
@@ -183,10 +404,75 @@ struct ov7251 {
 	u16 digital_gain;
 	u32 exposure_time;
 	struct v4l2_ctrl *pixel_rate;
+	/* Per-frame cluster, exposure is the master */
+	struct v4l2_ctrl *exposure;
+	struct v4l2_ctrl *gain;
+	struct v4l2_ctrl *analogue_gain;
+	struct v4l2_ctrl *vblank;
+	struct v4l2_ctrl *hblank;
 	const struct ov7251_mode *cur_mode;
 	struct i2c_client *rom;
 	struct inno_rom_table rom_table;
 	bool streaming;
+
+	/*
+	 * Serialises driver state and sensor/MCU register access, also used
+	 * as the control handler lock. Register writes after probe run on
+	 * the ordered workqueue: control changes only mark their group
+	 * dirty, and the MCU stream-on handshake runs without the lock held
+	 * so control callers never wait for it. The exceptions, all done
+	 * under this lock from the caller's context, are the exposure/gain/
+	 * VBLANK group while streaming, written by s_ctrl so its frame delay
+	 * counts from the call, and the counter reads behind the volatile
+	 * controls and debugfs "counters", which need the value now.
+	 */
+	struct mutex lock;
+	struct workqueue_struct *wq;
+	struct work_struct stream_work;
+	struct work_struct ctrl_work;
+	struct delayed_work counter_work;
+	bool starting;
+	u32 dirty;
+
+	/* Per-instance configuration, module parameter unless set in DT */
+	u32 bit_depth;
+	bool ext_trig;
+	u32 frame_rate;
+	struct v4l2_ctrl *ext_trig_ctrl;
+
+	/* Strobe output, a width of 0 tracks the exposure time */
+	bool strobe_enable;
+	bool strobe_invert;
+	u32 strobe_width;
+	u32 strobe_offset;
+
+	/*
+	 * Frame and trigger counters. The hardware counters are 16 bit, so
+	 * the deltas since stream-on are accumulated here on every read and
+	 * by counter_work while streaming. Only MCU firmware that declares
+	 * it (inno,trigger-counter in DT) has the trigger counter.
+	 */
+	u16 frame_cnt_raw;
+	u16 trig_cnt_raw;
+	bool trig_cnt_supported;
+	bool trig_cnt_valid;
+	u32 frames;
+	u32 triggers;
+	struct dentry *debugfs;
+	struct ov7251_i2c_stats i2c_stats;
+	struct ov7251_trigger trig;
+	struct ov7251_power power;
+
+	/* Streaming when suspended, restarted on resume */
+	bool resume_streaming;
+
+	/* Stream-on result, returned by s_stream(1) once the work is done */
+	int stream_err;
+
+	/* Alternating-exposure mode, one (exposure, gain) pair per bank */
+	bool bracket;
+	u32 bracket_banks[OV7251_BRACKET_BANKS * 2];
+	u32 bracket_start;
 };
 
 static const struct ov7251_mode supported_modes[] = {
@@ -199,6 +485,7 @@ static const struct ov7251_mode supported_modes[] = {
 		.max_fps = 120,
 		.hts_def = 772,
 		.vts_def = 0x23c,
+		.skip_frames = 1,
 		.reg_list = ov7251_setting_full_vga_10_183fps,
 		
 	},
@@ -212,6 +499,7 @@ static const struct ov7251_mode supported_modes[] = {
 		.max_fps = 120,
 		.hts_def = 772,
 		.vts_def = 0x23c,
+		.skip_frames = 1,
 		.reg_list = ov7251_setting_full_vga_8_183fps,
 		
 	},
@@ -225,6 +513,7 @@ static const struct ov7251_mode supported_modes[] = {
 		.max_fps = 120,
 		.hts_def = 772,
 		.vts_def = 0x23c, 
+		.skip_frames = 0,
 		.reg_list = ov7251_setting_full_vga_10_183fps,
 	},
 		{
@@ -236,9 +525,105 @@ static const struct ov7251_mode supported_modes[] = {
 		.max_fps = 120,
 		.hts_def = 772,
 		.vts_def = 0x23c,
+		.skip_frames = 0,
 		.reg_list = ov7251_setting_full_vga_8_183fps,
 	},
-	
+	{
+		.sensor_mode = 0,
+		.sensor_ext_trig = 0,
+		.sensor_depth = 10,
+		.width = 320,
+		.height = 240,
+		.max_fps = 206,
+		.hts_def = 772,
+		.vts_def = 240 + OV7251_VTS_MIN_OFFSET,
+		.skip_frames = 1,
+		.reg_list = ov7251_setting_qvga_skip2,
+	},
+	{
+		.sensor_mode = 1,
+		.sensor_ext_trig = 0,
+		.sensor_depth = 8,
+		.width = 320,
+		.height = 240,
+		.max_fps = 206,
+		.hts_def = 772,
+		.vts_def = 240 + OV7251_VTS_MIN_OFFSET,
+		.skip_frames = 1,
+		.reg_list = ov7251_setting_qvga_skip2,
+	},
+	{
+		.sensor_mode = 2,
+		.sensor_ext_trig = 1,
+		.sensor_depth = 10,
+		.width = 320,
+		.height = 240,
+		.max_fps = 206,
+		.hts_def = 772,
+		.vts_def = 240 + OV7251_VTS_MIN_OFFSET,
+		.skip_frames = 0,
+		.reg_list = ov7251_setting_qvga_skip2,
+	},
+	{
+		.sensor_mode = 3,
+		.sensor_ext_trig = 1,
+		.sensor_depth = 8,
+		.width = 320,
+		.height = 240,
+		.max_fps = 206,
+		.hts_def = 772,
+		.vts_def = 240 + OV7251_VTS_MIN_OFFSET,
+		.skip_frames = 0,
+		.reg_list = ov7251_setting_qvga_skip2,
+	},
+	{
+		.sensor_mode = 0,
+		.sensor_ext_trig = 0,
+		.sensor_depth = 10,
+		.width = 160,
+		.height = 120,
+		.max_fps = 323,
+		.hts_def = 772,
+		.vts_def = 120 + OV7251_VTS_MIN_OFFSET,
+		.skip_frames = 1,
+		.reg_list = ov7251_setting_qqvga_skip4,
+	},
+	{
+		.sensor_mode = 1,
+		.sensor_ext_trig = 0,
+		.sensor_depth = 8,
+		.width = 160,
+		.height = 120,
+		.max_fps = 323,
+		.hts_def = 772,
+		.vts_def = 120 + OV7251_VTS_MIN_OFFSET,
+		.skip_frames = 1,
+		.reg_list = ov7251_setting_qqvga_skip4,
+	},
+	{
+		.sensor_mode = 2,
+		.sensor_ext_trig = 1,
+		.sensor_depth = 10,
+		.width = 160,
+		.height = 120,
+		.max_fps = 323,
+		.hts_def = 772,
+		.vts_def = 120 + OV7251_VTS_MIN_OFFSET,
+		.skip_frames = 0,
+		.reg_list = ov7251_setting_qqvga_skip4,
+	},
+	{
+		.sensor_mode = 3,
+		.sensor_ext_trig = 1,
+		.sensor_depth = 8,
+		.width = 160,
+		.height = 120,
+		.max_fps = 323,
+		.hts_def = 772,
+		.vts_def = 120 + OV7251_VTS_MIN_OFFSET,
+		.skip_frames = 0,
+		.reg_list = ov7251_setting_qqvga_skip4,
+	},
 }; 
 
 static struct ov7251 *to_ov7251(const struct i2c_client *client)
@@ -246,9 +631,113 @@ static struct ov7251 *to_ov7251(const struct i2c_client *client)
 	return container_of(i2c_get_clientdata(client), struct ov7251, subdev);
 }
 
+/* Look up the mode matching this instance's bit depth, trigger setting and size */
+static const struct ov7251_mode *ov7251_find_mode(u32 depth, bool ext_trig,
+						  u32 width, u32 height)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(supported_modes); i++) {
+		if (supported_modes[i].sensor_depth == depth &&
+		    !!supported_modes[i].sensor_ext_trig == ext_trig &&
+		    supported_modes[i].width == width &&
+		    supported_modes[i].height == height)
+			return &supported_modes[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Bus recovery toggles SCL on the physical bus, which on the Pi is the
+ * root adapter behind the i2c-mux (i2c_csi_dsi / i2c_vc are mux
+ * children). Hold the root adapter lock so no other client on any mux
+ * segment starts a transfer while the lines are being clocked.
+ */
+static int ov7251_recover_bus(struct i2c_client *client)
+{
+	struct i2c_adapter *root = i2c_root_adapter(&client->adapter->dev);
+	int ret;
+
+	if (!root)
+		return -ENODEV;
+
+	i2c_lock_bus(client->adapter, I2C_LOCK_ROOT_ADAPTER);
+	ret = i2c_recover_bus(root);
+	i2c_unlock_bus(client->adapter, I2C_LOCK_ROOT_ADAPTER);
+
+	return ret;
+}
+
+/*
+ * All sensor and MCU transfers go through here. Both clients carry the
+ * subdev as client data, set in probe before the first transfer.
+ * Transient faults (NAK, timeout, lost arbitration) are retried with a
+ * short jittered backoff, so two cameras sharing a marginal bus do not
+ * retry in lockstep; any other error is returned at once. Returns 0 or
+ * a negative error code.
+ */
+static int ov7251_i2c_transfer(struct i2c_client *client,
+			       struct i2c_msg *msgs, int num)
+{
+	struct ov7251 *priv = to_ov7251(client);
+	struct ov7251_i2c_stats *st = &priv->i2c_stats;
+	unsigned int attempt, delay;
+	int ret;
+
+	atomic_inc(&st->transfers);
+
+	for (attempt = 0; ; attempt++) {
+		ret = i2c_transfer(client->adapter, msgs, num);
+		if (ret == num) {
+			if (attempt)
+				atomic_inc(&st->recovered);
+			return 0;
+		}
+		if (ret >= 0)
+			ret = -EIO;
+
+		switch (ret) {
+		case -ENXIO:
+		case -EREMOTEIO:
+			atomic_inc(&st->nak);
+			break;
+		case -ETIMEDOUT:
+			atomic_inc(&st->timeout);
+			break;
+		case -EAGAIN:
+			atomic_inc(&st->arb_lost);
+			break;
+		default:
+			/* Not a bus fault (bad message, adapter gone): don't retry */
+			atomic_inc(&st->other);
+			atomic_inc(&st->failed);
+			return ret;
+		}
+
+		if (attempt >= i2c_retries)
+			break;
+
+		/* A stuck SDA shows up as a timeout or lost arbitration */
+		if (i2c_recover && (ret == -ETIMEDOUT || ret == -EAGAIN) &&
+		    !ov7251_recover_bus(client))
+			atomic_inc(&st->bus_recoveries);
+
+		atomic_inc(&st->retries);
+		delay = OV7251_I2C_RETRY_US << min(attempt, 4U);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,2,0)
+		usleep_range(delay, delay + get_random_u32_below(delay));
+#else
+		usleep_range(delay, delay + prandom_u32_max(delay));
+#endif
+	}
+
+	atomic_inc(&st->failed);
+	return ret;
+}
+
 static int reg_write(struct i2c_client *client, const u16 addr, const u8 data)
 {
-	struct i2c_adapter *adap = client->adapter;
 	struct i2c_msg msg;
 	u8 tx[3];
 	int ret;
@@ -260,15 +749,14 @@ static int reg_write(struct i2c_client *client, const u16 addr, const u8 data)
 	tx[0] = addr >> 8;
 	tx[1] = addr & 0xff;
 	tx[2] = data;
-	ret = i2c_transfer(adap, &msg, 1);
+	ret = ov7251_i2c_transfer(client, &msg, 1);
 	mdelay(2);
 
-	return ret == 1 ? 0 : -EIO;
+	return ret;
 }
 
 static int rom_write(struct i2c_client *client, const u16 addr, const u8 data)
 {
-	struct i2c_adapter *adap = client->adapter;
 	struct i2c_msg msg;
 	u8 tx[2];
 	int ret;
@@ -279,10 +767,10 @@ static int rom_write(struct i2c_client *client, const u16 addr, const u8 data)
 	msg.flags = 0;
 	tx[0] = addr ;
 	tx[1] = data;	
-	ret = i2c_transfer(adap, &msg, 1);
+	ret = ov7251_i2c_transfer(client, &msg, 1);
 	mdelay(2);
 
-	return ret == 1 ? 0 : -EIO;
+	return ret;
 }
 
 static int reg_read(struct i2c_client *client, const u16 addr)
@@ -303,7 +791,7 @@ static int reg_read(struct i2c_client *client, const u16 addr)
 		},
 	};
 
-	ret = i2c_transfer(client->adapter, msgs, ARRAY_SIZE(msgs));
+	ret = ov7251_i2c_transfer(client, msgs, ARRAY_SIZE(msgs));
 	if (ret < 0) {
 		dev_warn(&client->dev, "Reading register %x from %x failed\n",
 			 addr, client->addr);
@@ -331,7 +819,7 @@ static int rom_read(struct i2c_client *client, const u16 addr)
 		},
 	};
 
-	ret = i2c_transfer(client->adapter, msgs, ARRAY_SIZE(msgs));
+	ret = ov7251_i2c_transfer(client, msgs, ARRAY_SIZE(msgs));
 	if (ret < 0) {
 		dev_warn(&client->dev, "Reading register %x from %x failed\n",
 			 addr, client->addr);
@@ -353,10 +841,812 @@ static int reg_write_table(struct i2c_client *client,
 			return ret;
 	}
 
-	return 0;
+	return 0;
+}
+
+static int ov7251_write_gain(struct i2c_client *client, u16 gain)
+{
+	int ret;
+
+	ret = reg_write(client, OV7251_AEC_AGC_ADJ_0, (gain & 0x0300) >> 8);/* goes to OV7251_AEC_AGC_ADJ_0 */
+	ret = ret ?: reg_write(client, OV7251_AEC_AGC_ADJ_1, gain & 0xff);
+
+	return ret;
+}
+
+static int ov7251_write_exposure(struct ov7251 *priv, u32 exposure)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
+	int ret;
+
+	ret = reg_write(client, OV7251_AEC_EXPO_0, (exposure & 0xf000) >> 12);
+	ret = ret ?: reg_write(client, OV7251_AEC_EXPO_1, (exposure & 0x0ff0) >> 4);
+	ret = ret ?: reg_write(client, OV7251_AEC_EXPO_2,  (exposure & 0x000f) << 4);
+
+	/* Keep the illumination pulse matched to the exposure */
+	if (priv->strobe_enable && !priv->strobe_width) {
+		ret = ret ?: reg_write(client, OV7251_STROBE_WIDTH_HIGH, (exposure >> 8) & 0xff);
+		ret = ret ?: reg_write(client, OV7251_STROBE_WIDTH_LOW, exposure & 0xff);
+	}
+
+	return ret;
+}
+
+static int ov7251_write_vts(struct i2c_client *client, u32 vts)
+{
+	int ret;
+
+	ret = reg_write(client, OV7251_VTS_HIGH, (vts >> 8) & 0xff);
+	ret = ret ?: reg_write(client, OV7251_VTS_LOW, vts & 0xff);
+
+	return ret;
+}
+
+/* Exposure has to end OV7251_EXPOSURE_OFFSET lines before the frame does */
+static u32 ov7251_exposure_max(struct ov7251 *priv, u32 vblank)
+{
+	return min_t(u32, OV7251_DIGITAL_EXPOSURE_MAX,
+		     priv->cur_mode->height + vblank - OV7251_EXPOSURE_OFFSET);
+}
+
+/*
+ * Write one control set (exposure, gain, VBLANK) inside a group hold and
+ * launch it, so all values latch at the same frame boundary however long
+ * the I2C writes take. While bracketing the banks own exposure and gain,
+ * so only VBLANK is written and it applies directly.
+ */
+static int ov7251_write_frame_ctrls(struct ov7251 *priv, bool vblank)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
+	u32 vts = priv->cur_mode->height + priv->vblank->val;
+	int ret;
+
+	if (priv->bracket)
+		return vblank ? ov7251_write_vts(client, vts) : 0;
+
+	/* Still in standby during the stream-on replay, values apply directly */
+	if (priv->starting) {
+		ret = ov7251_write_exposure(priv, priv->exposure_time);
+		ret = ret ?: ov7251_write_gain(client, priv->digital_gain);
+		if (vblank)
+			ret = ret ?: ov7251_write_vts(client, vts);
+		return ret;
+	}
+
+	ret = reg_write(client, OV7251_GROUP_ACCESS,
+			 OV7251_GROUP_ACCESS_START | OV7251_FRAME_CTRL_BANK);
+	ret = ret ?: ov7251_write_exposure(priv, priv->exposure_time);
+	ret = ret ?: ov7251_write_gain(client, priv->digital_gain);
+	if (vblank)
+		ret = ret ?: ov7251_write_vts(client, vts);
+	ret = ret ?: reg_write(client, OV7251_GROUP_ACCESS,
+			 OV7251_GROUP_ACCESS_END | OV7251_FRAME_CTRL_BANK);
+	ret = ret ?: reg_write(client, OV7251_GROUP_ACCESS,
+			 OV7251_GROUP_ACCESS_LAUNCH | OV7251_FRAME_CTRL_BANK);
+
+	return ret;
+}
+
+static int ov7251_write_strobe(struct ov7251 *priv)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
+	u32 width = priv->strobe_width ? priv->strobe_width : priv->exposure_time;
+	u8 ctrl = 0;
+	int ret;
+
+	if (priv->strobe_enable)
+		ctrl |= OV7251_STROBE_CTRL_ENABLE;
+	if (priv->strobe_invert)
+		ctrl |= OV7251_STROBE_CTRL_INVERT;
+
+	ret = reg_write(client, OV7251_STROBE_OFFSET_HIGH, (priv->strobe_offset >> 8) & 0xff);
+	ret = ret ?: reg_write(client, OV7251_STROBE_OFFSET_LOW, priv->strobe_offset & 0xff);
+	ret = ret ?: reg_write(client, OV7251_STROBE_WIDTH_HIGH, (width >> 8) & 0xff);
+	ret = ret ?: reg_write(client, OV7251_STROBE_WIDTH_LOW, width & 0xff);
+	ret = ret ?: reg_write(client, OV7251_STROBE_CTRL, ctrl);
+
+	return ret;
+}
+
+static int ov7251_read_frame_cnt(struct ov7251 *priv, u16 *cnt)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
+	int hi, lo;
+
+	hi = reg_read(client, OV7251_FRAME_CNT_HIGH);
+	if (hi < 0)
+		return hi;
+	lo = reg_read(client, OV7251_FRAME_CNT_LOW);
+	if (lo < 0)
+		return lo;
+
+	*cnt = (hi << 8) | lo;
+	return 0;
+}
+
+/* Trigger pulses seen by the MCU, registers 210/211 */
+static int ov7251_read_trig_cnt(struct ov7251 *priv, u16 *cnt)
+{
+	int hi, lo;
+
+	if (!priv->rom)
+		return -ENODEV;
+
+	hi = rom_read(priv->rom, 210);
+	if (hi < 0)
+		return hi;
+	lo = rom_read(priv->rom, 211);
+	if (lo < 0)
+		return lo;
+
+	*cnt = (hi << 8) | lo;
+	return 0;
+}
+
+/* Latch the hardware counters as the stream-on reference */
+static void ov7251_reset_counters(struct ov7251 *priv)
+{
+	priv->frames = 0;
+	priv->triggers = 0;
+	if (ov7251_read_frame_cnt(priv, &priv->frame_cnt_raw) < 0)
+		priv->frame_cnt_raw = 0;
+	priv->trig_cnt_valid = priv->trig_cnt_supported &&
+		!ov7251_read_trig_cnt(priv, &priv->trig_cnt_raw);
+}
+
+/* Fold the hardware counters into the since-stream-on totals */
+static void ov7251_update_counters(struct ov7251 *priv)
+{
+	u16 cnt;
+
+	/* Not latched until the stream-on handshake is done */
+	if (!priv->streaming || priv->starting)
+		return;
+
+	if (!ov7251_read_frame_cnt(priv, &cnt)) {
+		priv->frames += (u16)(cnt - priv->frame_cnt_raw);
+		priv->frame_cnt_raw = cnt;
+	}
+
+	if (priv->trig_cnt_valid && !ov7251_read_trig_cnt(priv, &cnt)) {
+		priv->triggers += (u16)(cnt - priv->trig_cnt_raw);
+		priv->trig_cnt_raw = cnt;
+	}
+}
+
+/* Keeps the totals right when nobody reads them for a long time */
+static void ov7251_counter_work(struct work_struct *work)
+{
+	struct ov7251 *priv = container_of(to_delayed_work(work),
+					   struct ov7251, counter_work);
+
+	mutex_lock(&priv->lock);
+	if (priv->streaming) {
+		ov7251_update_counters(priv);
+		queue_delayed_work(priv->wq, &priv->counter_work,
+				   msecs_to_jiffies(OV7251_COUNTER_POLL_MS));
+	}
+	mutex_unlock(&priv->lock);
+}
+
+static int ov7251_counters_show(struct seq_file *m, void *unused)
+{
+	struct ov7251 *priv = m->private;
+
+	mutex_lock(priv->ctrl_handler.lock);
+	ov7251_update_counters(priv);
+
+	seq_printf(m, "streaming:       %d\n", priv->streaming);
+	seq_printf(m, "frame_count:     %u\n", priv->frame_cnt_raw);
+	seq_printf(m, "frames:          %u\n", priv->frames);
+	if (priv->trig_cnt_valid) {
+		seq_printf(m, "trigger_count:   %u\n", priv->trig_cnt_raw);
+		seq_printf(m, "triggers:        %u\n", priv->triggers);
+		seq_printf(m, "missed_triggers: %d\n",
+			   (s32)(priv->triggers - priv->frames));
+	} else {
+		seq_puts(m, "trigger_count:   n/a\n");
+	}
+	mutex_unlock(priv->ctrl_handler.lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ov7251_counters);
+
+static int ov7251_i2c_stats_show(struct seq_file *m, void *unused)
+{
+	struct ov7251 *priv = m->private;
+	struct ov7251_i2c_stats *st = &priv->i2c_stats;
+
+	seq_printf(m, "transfers:       %d\n", atomic_read(&st->transfers));
+	seq_printf(m, "nak:             %d\n", atomic_read(&st->nak));
+	seq_printf(m, "timeout:         %d\n", atomic_read(&st->timeout));
+	seq_printf(m, "arb_lost:        %d\n", atomic_read(&st->arb_lost));
+	seq_printf(m, "other:           %d\n", atomic_read(&st->other));
+	seq_printf(m, "retries:         %d\n", atomic_read(&st->retries));
+	seq_printf(m, "recovered:       %d\n", atomic_read(&st->recovered));
+	seq_printf(m, "failed:          %d\n", atomic_read(&st->failed));
+	seq_printf(m, "bus_recoveries:  %d\n", atomic_read(&st->bus_recoveries));
+	seq_printf(m, "ctrl_failed:     %d\n", atomic_read(&st->ctrl_failed));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ov7251_i2c_stats);
+
+/* First multiple of the period after t */
+static ktime_t ov7251_trigger_slot(ktime_t t, u64 period_ns)
+{
+	return ns_to_ktime((div64_u64(ktime_to_ns(t), period_ns) + 1) * period_ns);
+}
+
+/*
+ * Sleeps on an absolute hrtimer rather than toggling the line from the
+ * timer callback, so GPIO controllers that sleep (I2C expanders) work
+ * too. Runs SCHED_FIFO to keep wakeup latency in the tens of us.
+ */
+static int ov7251_trigger_thread(void *data)
+{
+	struct ov7251_trigger *trig = data;
+	struct ov7251_trigger_edge *e;
+	ktime_t next, now, slot;
+	s64 late;
+	u32 missed;
+
+	next = ov7251_trigger_slot(ktime_get(), trig->period_ns);
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop()) {
+			__set_current_state(TASK_RUNNING);
+			break;
+		}
+		schedule_hrtimeout_range(&next, 0, HRTIMER_MODE_ABS);
+		if (kthread_should_stop())
+			break;
+
+		gpiod_set_value_cansleep(trig->gpio, 1);
+		now = ktime_get();
+		late = ktime_to_ns(ktime_sub(now, next));
+
+		spin_lock(&trig->log_lock);
+		e = &trig->log[trig->seq % OV7251_TRIGGER_LOG];
+		e->seq = trig->seq++;
+		e->time = now;
+		e->late_ns = min_t(s64, late, S32_MAX);
+		trig->late_max_ns = max(trig->late_max_ns, e->late_ns);
+		spin_unlock(&trig->log_lock);
+
+		usleep_range(OV7251_TRIGGER_PULSE_US, OV7251_TRIGGER_PULSE_US + 10);
+		gpiod_set_value_cansleep(trig->gpio, 0);
+
+		/* Fell a whole period behind: skip ahead rather than burst */
+		next = ktime_add_ns(next, trig->period_ns);
+		now = ktime_get();
+		if (ktime_before(next, now)) {
+			slot = ov7251_trigger_slot(now, trig->period_ns);
+			missed = div64_u64(ktime_to_ns(ktime_sub(slot, next)),
+					   trig->period_ns);
+			spin_lock(&trig->log_lock);
+			trig->skipped += missed;
+			spin_unlock(&trig->log_lock);
+			next = slot;
+		}
+	}
+
+	gpiod_set_value_cansleep(trig->gpio, 0);
+	return 0;
+}
+
+/* Runs only while streaming in a trigger mode with a rate set */
+static int ov7251_trigger_start(struct ov7251 *priv)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
+	struct ov7251_trigger *trig = &priv->trig;
+	struct task_struct *thread;
+
+	lockdep_assert_held(&priv->lock);
+
+	if (!trig->gpio || !trig->rate || trig->thread ||
+	    !priv->cur_mode->sensor_ext_trig)
+		return 0;
+
+	trig->period_ns = div64_u64(NSEC_PER_SEC * 1000ULL, trig->rate);
+	spin_lock(&trig->log_lock);
+	trig->seq = 0;
+	trig->skipped = 0;
+	trig->late_max_ns = 0;
+	spin_unlock(&trig->log_lock);
+
+	thread = kthread_create(ov7251_trigger_thread, trig, "ov7251-trig/%s",
+				dev_name(&client->dev));
+	if (IS_ERR(thread)) {
+		dev_err(&client->dev, "failed to start trigger thread: %ld\n",
+			PTR_ERR(thread));
+		return PTR_ERR(thread);
+	}
+	sched_set_fifo(thread);
+	trig->thread = thread;
+	wake_up_process(thread);
+
+	return 0;
+}
+
+static void ov7251_trigger_stop(struct ov7251 *priv)
+{
+	lockdep_assert_held(&priv->lock);
+
+	if (!priv->trig.thread)
+		return;
+
+	kthread_stop(priv->trig.thread);
+	priv->trig.thread = NULL;
+}
+
+static int ov7251_trigger_show(struct seq_file *m, void *unused)
+{
+	struct ov7251 *priv = m->private;
+	struct ov7251_trigger *trig = &priv->trig;
+	struct ov7251_trigger_edge *e;
+	u32 i, n;
+
+	mutex_lock(&priv->lock);
+	seq_printf(m, "rate_mhz:        %u\n", trig->rate);
+	seq_printf(m, "running:         %d\n", !!trig->thread);
+	mutex_unlock(&priv->lock);
+
+	spin_lock(&trig->log_lock);
+	seq_printf(m, "edges:           %u\n", trig->seq);
+	seq_printf(m, "skipped:         %u\n", trig->skipped);
+	seq_printf(m, "late_max_ns:     %d\n", trig->late_max_ns);
+	seq_puts(m, "seq        time_ns              late_ns\n");
+	n = min_t(u32, trig->seq, OV7251_TRIGGER_LOG);
+	for (i = trig->seq - n; i != trig->seq; i++) {
+		e = &trig->log[i % OV7251_TRIGGER_LOG];
+		seq_printf(m, "%-10u %-20lld %d\n", e->seq,
+			   ktime_to_ns(e->time), e->late_ns);
+	}
+	spin_unlock(&trig->log_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ov7251_trigger);
+
+static int ov7251_power_show(struct seq_file *m, void *unused)
+{
+	struct ov7251 *priv = m->private;
+	struct ov7251_power *pwr = &priv->power;
+
+	mutex_lock(&priv->lock);
+	seq_printf(m, "powered:         %d\n", pwr->on);
+	seq_printf(m, "power_cycles:    %u\n", pwr->cycles);
+	seq_printf(m, "mcu_boot_us:     %lld\n", pwr->boot_us);
+	seq_printf(m, "wake_us:         %lld\n", pwr->wake_us);
+	seq_printf(m, "wake_max_us:     %lld\n", pwr->wake_max_us);
+	mutex_unlock(&priv->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ov7251_power);
+
+/*
+ * Load each (exposure, gain) pair into its own group hold bank and let the
+ * sensor alternate between them every frame, so bracketing needs no host
+ * I/O per frame. Frame N after the switch is enabled uses bank
+ * N % OV7251_BRACKET_BANKS, which V4L2_CID_OV7251_BRACKET_BANK reports.
+ */
+static int ov7251_write_bracket(struct ov7251 *priv)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
+	unsigned int bank;
+	int ret;
+
+	if (!priv->bracket) {
+		ret = reg_write(client, OV7251_GROUP_SWITCH, 0);
+		ret = ret ?: ov7251_write_exposure(priv, priv->exposure_time);
+		ret = ret ?: ov7251_write_gain(client, priv->digital_gain);
+		return ret;
+	}
+
+	ret = reg_write(client, OV7251_GROUP_SWITCH, 0);
+	for (bank = 0; bank < OV7251_BRACKET_BANKS; bank++) {
+		u32 exposure = priv->bracket_banks[bank * 2];
+		u32 gain = priv->bracket_banks[bank * 2 + 1];
+
+		if (!exposure)
+			exposure = priv->exposure_time;
+		if (!gain)
+			gain = priv->digital_gain;
+		exposure = clamp_t(u32, exposure, OV7251_DIGITAL_EXPOSURE_MIN,
+				   ov7251_exposure_max(priv, priv->vblank->val));
+		gain = min_t(u32, gain, OV7251_DIGITAL_GAIN_MAX);
+
+		ret = ret ?: reg_write(client, OV7251_GROUP_ACCESS,
+				 OV7251_GROUP_ACCESS_START | bank);
+		ret = ret ?: ov7251_write_exposure(priv, exposure);
+		ret = ret ?: ov7251_write_gain(client, gain);
+		ret = ret ?: reg_write(client, OV7251_GROUP_ACCESS,
+				 OV7251_GROUP_ACCESS_END | bank);
+	}
+	ret = ret ?: reg_write(client, OV7251_GROUP0_FRAMES, 1);
+	ret = ret ?: reg_write(client, OV7251_GROUP1_FRAMES, 1);
+	ret = ret ?: reg_write(client, OV7251_GROUP_SWITCH, OV7251_GROUP_SWITCH_AUTO);
+	ret = ret ?: reg_write(client, OV7251_GROUP_ACCESS, OV7251_GROUP_ACCESS_LAUNCH);
+	if (ret)
+		return ret;
+
+	/*
+	 * The launch latches at the next frame boundary, so bank 0 starts
+	 * one frame after the one in progress now. Read the counter only
+	 * after the launch write, so a boundary passing during the bank
+	 * writes cannot shift the phase. During the stream-on replay the
+	 * sensor is still in standby and frame 0 is the first bank-0 frame.
+	 */
+	if (priv->starting) {
+		priv->bracket_start = 0;
+	} else {
+		ov7251_update_counters(priv);
+		priv->bracket_start = priv->frames + 1;
+	}
+
+	return 0;
+}
+
+/* Write every dirty control group, called with priv->lock held */
+static int ov7251_apply_ctrls(struct ov7251 *priv)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
+	u32 dirty = priv->dirty;
+	int ret = 0;
+
+	lockdep_assert_held(&priv->lock);
+
+	/* Only the latest value of each control is ever written */
+	priv->dirty = 0;
+
+	if (dirty & OV7251_DIRTY_HFLIP)
+		ret = ret ?: reg_write(client, OV7251_TIMING_FORMAT2,
+				 priv->hflip ? 0x04 : 0x00);
+	if (dirty & OV7251_DIRTY_VFLIP)
+		ret = ret ?: reg_write(client, OV7251_TIMING_FORMAT1,
+				 priv->vflip ? 0x04 : 0x40);
+	if (dirty & (OV7251_DIRTY_FRAME | OV7251_DIRTY_VBLANK))
+		ret = ret ?: ov7251_write_frame_ctrls(priv,
+						dirty & OV7251_DIRTY_VBLANK);
+	if (dirty & OV7251_DIRTY_BRACKET)
+		ret = ret ?: ov7251_write_bracket(priv);
+	if (dirty & OV7251_DIRTY_STROBE)
+		ret = ret ?: ov7251_write_strobe(priv);
+
+	/* Try the whole set again with the next change */
+	if (ret)
+		priv->dirty |= dirty;
+
+	return ret;
+}
+
+/*
+ * Writes everything s_ctrl only marked dirty. Counter reads and the
+ * per-frame group bypass this worker, see the comment on priv->lock.
+ */
+static void ov7251_ctrl_work(struct work_struct *work)
+{
+	struct ov7251 *priv = container_of(work, struct ov7251, ctrl_work);
+	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
+
+	int ret;
+
+	mutex_lock(&priv->lock);
+	/* Left dirty while starting, the stream-on work applies them */
+	if (priv->streaming && !priv->starting && priv->dirty) {
+		ret = ov7251_apply_ctrls(priv);
+		if (ret) {
+			dev_err(&client->dev, "failed to apply controls: %d\n", ret);
+			atomic_inc(&priv->i2c_stats.ctrl_failed);
+		}
+	}
+	mutex_unlock(&priv->lock);
+}
+
+/*
+ * Single quiet MCU register read: no retries, no warning and not counted
+ * as an I2C error, since NAKs are expected while the MCU boots.
+ */
+static int ov7251_mcu_peek(struct ov7251 *priv, u8 reg)
+{
+	u8 buf[1] = { reg };
+	struct i2c_msg msgs[] = {
+		{
+			.addr  = priv->rom->addr,
+			.flags = 0,
+			.len   = 1,
+			.buf   = buf,
+		}, {
+			.addr  = priv->rom->addr,
+			.flags = I2C_M_RD,
+			.len   = 1,
+			.buf   = buf,
+		},
+	};
+	int ret;
+
+	ret = i2c_transfer(priv->rom->adapter, msgs, ARRAY_SIZE(msgs));
+	if (ret != ARRAY_SIZE(msgs))
+		return ret < 0 ? ret : -EIO;
+
+	return buf[0];
+}
+
+/*
+ * Wait for the MCU to answer after power-up. Runs without priv->lock,
+ * like the rest of the stream-on handshake; the result is stored under it.
+ */
+static int ov7251_mcu_wait_boot(struct ov7251 *priv, ktime_t on_time,
+				s64 *boot_us)
+{
+	int status;
+
+	usleep_range(OV7251_POWERON_MIN_US, OV7251_POWERON_MIN_US + 50);
+
+	while ((status = ov7251_mcu_peek(priv, 201)) < 0 &&
+	       ktime_us_delta(ktime_get(), on_time) < OV7251_MCU_BOOT_TIMEOUT_US)
+		usleep_range(OV7251_MCU_BOOT_POLL_US, OV7251_MCU_BOOT_POLL_US + 200);
+
+	*boot_us = ktime_us_delta(ktime_get(), on_time);
+	mutex_lock(&priv->lock);
+	priv->power.boot_us = *boot_us;
+	mutex_unlock(&priv->lock);
+
+	return status < 0 ? -ETIMEDOUT : 0;
+}
+
+/* The power state itself only changes under priv->lock */
+static int ov7251_power_on(struct ov7251 *priv)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
+	struct ov7251_power *pwr = &priv->power;
+	ktime_t on_time;
+	s64 off_us, boot_us;
+	int ret;
+
+	mutex_lock(&priv->lock);
+	if (!pwr->pwdn || pwr->on) {
+		mutex_unlock(&priv->lock);
+		return 0;
+	}
+
+	off_us = ktime_us_delta(ktime_get(), pwr->off_time);
+	if (off_us < OV7251_POWEROFF_MIN_US)
+		usleep_range(OV7251_POWEROFF_MIN_US - off_us,
+			     OV7251_POWEROFF_MIN_US - off_us + 100);
+
+	gpiod_set_value_cansleep(pwr->pwdn, 0);
+	on_time = ktime_get();
+	pwr->on_time = on_time;
+	pwr->on = true;
+	pwr->cycles++;
+	mutex_unlock(&priv->lock);
+
+	if (!priv->rom) {
+		usleep_range(OV7251_POWERON_MIN_US, OV7251_POWERON_MIN_US + 50);
+		return 0;
+	}
+
+	ret = ov7251_mcu_wait_boot(priv, on_time, &boot_us);
+	if (ret)
+		dev_err(&client->dev, "MCU not answering %lld us after power on\n",
+			boot_us);
+	else
+		dev_info(&client->dev, "power on: MCU answering after %lld us\n",
+			 boot_us);
+
+	return ret;
+}
+
+static void ov7251_power_off(struct ov7251 *priv)
+{
+	struct ov7251_power *pwr = &priv->power;
+
+	lockdep_assert_held(&priv->lock);
+
+	if (!pwr->pwdn || !pwr->on)
+		return;
+
+	gpiod_set_value_cansleep(pwr->pwdn, 1);
+	pwr->off_time = ktime_get();
+	pwr->on = false;
+}
+
+/*
+ * Power an idle camera down: through the pwdn line when the driver owns
+ * it, else with the MCU powerdown command. Takes priv->lock itself.
+ */
+static int ov7251_power_down(struct ov7251 *priv)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
+	int ret = 0;
+
+	mutex_lock(&priv->lock);
+	ov7251_power_off(priv);
+	mutex_unlock(&priv->lock);
+
+	if (!priv->power.pwdn && priv->rom) {
+		ret = rom_write(priv->rom, 200, 2); /* powerdown */
+		dev_info(&client->dev, "MCU powerdown ret=%d\n", ret);
+		mdelay(50);
+	}
+
+	return ret;
+}
+
+static void ov7251_set_led(struct ov7251 *priv, bool on)
+{
+	if (priv->power.led)
+		gpiod_set_value_cansleep(priv->power.led, on);
+}
+
+static int ov7251_mcu_start(struct ov7251 *priv,
+			    const struct ov7251_mode *mode)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
+	int ret, reg = -EIO, i;
+
+	/* Re-send mode index — MCU may have lost it after powerdown */
+	ret = rom_write(priv->rom, 202, mode->sensor_mode);
+	dev_info(&client->dev, "s_stream: MCU set mode %d ret=%d\n",
+		 mode->sensor_mode, ret);
+	if (ret)
+		return ret;
+	msleep(20);
+
+	/* Start command */
+	ret = rom_write(priv->rom, 200, 1);
+	dev_info(&client->dev, "s_stream: MCU start (200,1) ret=%d\n", ret);
+	if (ret)
+		return ret;
+
+	/* MCU is busy programming the sensor — retry STATUS read */
+	for (i = 0; i < 15; i++) {
+		msleep(100);
+		reg = rom_read(priv->rom, 201);
+		dev_info(&client->dev, "s_stream: MCU STATUS=0x%02x i=%d\n", reg, i);
+		if (reg >= 0 && (reg & 0x80) && !(reg & 0x01))
+			break;
+	}
+	/* Not ready but answering: carry on as before, the sensor may be fine */
+	if (reg < 0)
+		return reg;
+	if (i == 15)
+		dev_warn(&client->dev, "s_stream: MCU not ready, STATUS=0x%02x\n", reg);
+
+	/* Set ext_trig via MCU */
+	ret = rom_write(priv->rom, 208, mode->sensor_ext_trig ? 1 : 0);
+	msleep(10);
+
+	return ret;
+}
+
+static void ov7251_stream_work(struct work_struct *work)
+{
+	struct ov7251 *priv = container_of(work, struct ov7251, stream_work);
+	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
+	const struct ov7251_mode *mode;
+	int ret = 0;
+
+	mutex_lock(&priv->lock);
+	mode = priv->cur_mode;
+	mutex_unlock(&priv->lock);
+
+	/*
+	 * Nothing else talks to the MCU until s_stream(0), which flushes
+	 * this work first, so the slow handshake runs unlocked.
+	 */
+	ret = ov7251_power_on(priv);
+	if (!ret && priv->rom)
+		ret = ov7251_mcu_start(priv, mode);
+
+	mutex_lock(&priv->lock);
+	if (ret) {
+		dev_err(&client->dev, "MCU start failed: %d\n", ret);
+		goto error;
+	}
+
+	/* Output size and subsampling on top of the MCU's VGA setup */
+	ret = reg_write_table(client, mode->reg_list);
+	if (ret) {
+		dev_err(&client->dev, "failed to set %ux%u mode: %d\n",
+			mode->width, mode->height, ret);
+		goto error;
+	}
+
+	ov7251_reset_counters(priv);
+
+	/*
+	 * The MCU has just reprogrammed the sensor, so replay the whole
+	 * control state, including anything set while stopped or during
+	 * the handshake, before the first frame is output.
+	 */
+	priv->dirty = OV7251_DIRTY_ALL;
+	/* Leave the MCU's defaults alone for features that are off */
+	if (!priv->bracket)
+		priv->dirty &= ~OV7251_DIRTY_BRACKET;
+	if (!priv->strobe_enable)
+		priv->dirty &= ~OV7251_DIRTY_STROBE;
+	ret = ov7251_apply_ctrls(priv);
+	if (ret) {
+		dev_err(&client->dev, "failed to apply controls: %d\n", ret);
+		goto error;
+	}
+	priv->starting = false;
+
+	/* Sensor ignores trigger pulses until it leaves standby below */
+	ret = ov7251_trigger_start(priv);
+	if (ret)
+		goto error;
+
+	/* Start sensor MIPI output — MCU configures PLL/timing but doesn't set this bit */
+	ret = reg_write(client, OV7251_SC_MODE_SELECT, OV7251_SC_MODE_SELECT_STREAMING);
+	dev_info(&client->dev, "s_stream: sensor stream-on (0x0100=1) ret=%d\n", ret);
+	if (ret)
+		goto error;
+
+	if (priv->power.pwdn) {
+		struct ov7251_power *pwr = &priv->power;
+
+		pwr->wake_us = ktime_us_delta(ktime_get(), pwr->on_time);
+		pwr->wake_max_us = max(pwr->wake_max_us, pwr->wake_us);
+		dev_info(&client->dev, "s_stream: streaming %lld us after power on\n",
+			 pwr->wake_us);
+	}
+	ov7251_set_led(priv, true);
+	queue_delayed_work(priv->wq, &priv->counter_work,
+			   msecs_to_jiffies(OV7251_COUNTER_POLL_MS));
+
+	priv->stream_err = 0;
+	mutex_unlock(&priv->lock);
+	return;
+
+error:
+	ov7251_trigger_stop(priv);
+	ov7251_power_off(priv);
+	priv->stream_err = ret;
+	priv->streaming = false;
+	priv->starting = false;
+	priv->dirty = 0;
+	mutex_unlock(&priv->lock);
 }
 
 /* V4L2 subdev video operations */
+/* Shared by s_stream(0) and system suspend, false if already stopped */
+static bool ov7251_stop_streaming(struct ov7251 *priv, int *ret)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
+	int err;
+
+	/* Let a pending stream-on or control write finish first */
+	flush_workqueue(priv->wq);
+	cancel_delayed_work_sync(&priv->counter_work);
+
+	mutex_lock(&priv->lock);
+	if (!priv->streaming) {
+		mutex_unlock(&priv->lock);
+		*ret = 0;
+		return false;
+	}
+	ov7251_update_counters(priv);
+	priv->streaming = false;
+	priv->dirty = 0;
+	ov7251_trigger_stop(priv);
+	/* Stop sensor MIPI output first */
+	*ret = reg_write(client, OV7251_SC_MODE_SELECT, OV7251_SC_MODE_SELECT_SW_STANDBY);
+	ov7251_set_led(priv, false);
+	mutex_unlock(&priv->lock);
+
+	err = ov7251_power_down(priv);
+	*ret = *ret ?: err;
+
+	return true;
+}
+
 static int ov7251_s_stream(struct v4l2_subdev *sd, int enable)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(sd);
@@ -365,52 +1655,33 @@ static int ov7251_s_stream(struct v4l2_subdev *sd, int enable)
 
 	dev_info(&client->dev, "s_stream(%d) called\n", enable);
 
+	/* Mode is latched into the MCU at stream-on; keep it fixed meanwhile */
+	if (priv->ext_trig_ctrl)
+		v4l2_ctrl_grab(priv->ext_trig_ctrl, enable);
+
 	if (!enable) {
-		priv->streaming = false;
-		/* Stop sensor MIPI output first */
-		reg_write(client, OV7251_SC_MODE_SELECT, OV7251_SC_MODE_SELECT_SW_STANDBY);
-		if (priv->rom) {
-			ret = rom_write(priv->rom, 200, 2); /* powerdown */
-			dev_info(&client->dev, "s_stream: MCU powerdown ret=%d\n", ret);
-			mdelay(50);
-		}
-		return 0;
+		ov7251_stop_streaming(priv, &ret);
+		return ret;
 	}
 
+	mutex_lock(&priv->lock);
+	if (priv->streaming) {
+		mutex_unlock(&priv->lock);
+		return 0;
+	}
 	priv->streaming = true;
+	priv->starting = true;
+	mutex_unlock(&priv->lock);
 
-	if (priv->rom) {
-		int reg, i;
-
-		/* Re-send mode index — MCU may have lost it after powerdown */
-		ret = rom_write(priv->rom, 202, priv->cur_mode->sensor_mode);
-		dev_info(&client->dev, "s_stream: MCU set mode %d ret=%d\n",
-			 priv->cur_mode->sensor_mode, ret);
-		msleep(20);
-
-		/* Start command */
-		ret = rom_write(priv->rom, 200, 1);
-		dev_info(&client->dev, "s_stream: MCU start (200,1) ret=%d\n", ret);
-
-		/* MCU is busy programming the sensor — retry STATUS read */
-		for (i = 0; i < 15; i++) {
-			msleep(100);
-			reg = rom_read(priv->rom, 201);
-			dev_info(&client->dev, "s_stream: MCU STATUS=0x%02x i=%d\n", reg, i);
-			if (reg >= 0 && (reg & 0x80) && !(reg & 0x01))
-				break;
-		}
-
-		/* Set ext_trig via MCU */
-		ret = rom_write(priv->rom, 208, priv->cur_mode->sensor_ext_trig ? 1 : 0);
-		msleep(10);
-	}
+	/* Only this caller waits for the handshake, controls stay responsive */
+	queue_work(priv->wq, &priv->stream_work);
+	flush_work(&priv->stream_work);
 
-	/* Start sensor MIPI output — MCU configures PLL/timing but doesn't set this bit */
-	ret = reg_write(client, OV7251_SC_MODE_SELECT, OV7251_SC_MODE_SELECT_STREAMING);
-	dev_info(&client->dev, "s_stream: sensor stream-on (0x0100=1) ret=%d\n", ret);
+	ret = priv->stream_err;
+	if (ret && priv->ext_trig_ctrl)
+		v4l2_ctrl_grab(priv->ext_trig_ctrl, false);
 
-	return 0;
+	return ret;
 }
 
 /* V4L2 subdev core operations */
@@ -435,87 +1706,163 @@ static int ov7251_s_ctrl(struct v4l2_ctrl *ctrl)
 	struct ov7251 *priv =
 	    container_of(ctrl->handler, struct ov7251, ctrl_handler);
 	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
-	u8 reg;
+	u32 dirty = 0;
 	int ret;
 	u16 gain = 0;
 	u32 exposure = 0;
 
-	/* Don't write to sensor during probe/init */
-	if (!priv->streaming)
-		return 0;
-
 	switch (ctrl->id) {
 	case V4L2_CID_HFLIP:
 		priv->hflip = ctrl->val;
-		if(ctrl->val)
-		 ret=reg_write(client, OV7251_TIMING_FORMAT2,0x04 );
-	        else
-		 ret=reg_write(client, OV7251_TIMING_FORMAT2,  0x00);		
-             return ret;    
+		dirty = OV7251_DIRTY_HFLIP;
+		break;
 	case V4L2_CID_VFLIP:
 		priv->vflip = ctrl->val;
-		if(ctrl->val)
-		 ret=reg_write(client, OV7251_TIMING_FORMAT1, 0x04);
-	        else		 
-		 ret=reg_write(client, OV7251_TIMING_FORMAT1, 0x40);		
-       	     return ret;
-	case V4L2_CID_GAIN:
-
-		gain = ctrl->val;
-
-		if (gain < OV7251_DIGITAL_GAIN_MIN) 
-			gain = OV7251_DIGITAL_GAIN_MIN;
-		if (gain > OV7251_DIGITAL_GAIN_MAX)
-			gain = OV7251_DIGITAL_GAIN_MAX;
-		
-		priv->digital_gain = gain;
-		dev_info(&client->dev, "GAIN = %d \n",gain);
+		dirty = OV7251_DIRTY_VFLIP;
+		break;
+	case V4L2_CID_OV7251_STROBE_ENABLE:
+		priv->strobe_enable = ctrl->val;
+		dirty = OV7251_DIRTY_STROBE;
+		break;
+	case V4L2_CID_OV7251_STROBE_INVERT:
+		priv->strobe_invert = ctrl->val;
+		dirty = OV7251_DIRTY_STROBE;
+		break;
+	case V4L2_CID_OV7251_STROBE_WIDTH:
+		priv->strobe_width = ctrl->val;
+		dirty = OV7251_DIRTY_STROBE;
+		break;
+	case V4L2_CID_OV7251_STROBE_OFFSET:
+		priv->strobe_offset = ctrl->val;
+		dirty = OV7251_DIRTY_STROBE;
+		break;
+	case V4L2_CID_OV7251_BRACKET:
+		priv->bracket = ctrl->val;
+		dirty = OV7251_DIRTY_BRACKET;
+		break;
+	case V4L2_CID_OV7251_BRACKET_BANKS:
+		memcpy(priv->bracket_banks, ctrl->p_new.p_u32,
+		       sizeof(priv->bracket_banks));
+		dirty = OV7251_DIRTY_BRACKET;
+		break;
+	case V4L2_CID_EXPOSURE:
+		/*
+		 * Cluster master, called once for the whole control set. The
+		 * exposure limit follows the new VBLANK straight away; the
+		 * control's range catches up in ov7251_ctrl_notify().
+		 */
+		exposure = clamp_t(u32, priv->exposure->val,
+				   OV7251_DIGITAL_EXPOSURE_MIN,
+				   ov7251_exposure_max(priv, priv->vblank->val));
+		priv->exposure_time = exposure;
+
+		/* Both gain controls drive the same registers, newest wins */
+		if (priv->analogue_gain->is_new)
+			gain = priv->analogue_gain->val;
+		else if (priv->gain->is_new)
+			gain = priv->gain->val;
+		else
+			gain = priv->digital_gain;
+		priv->digital_gain = min_t(u16, gain, OV7251_DIGITAL_GAIN_MAX);
+
+		if (priv->exposure->is_new || priv->gain->is_new ||
+		    priv->analogue_gain->is_new)
+			dirty |= OV7251_DIRTY_FRAME;
+		/* Banks left at 0 follow exposure and gain, reload them */
+		if ((dirty & OV7251_DIRTY_FRAME) && priv->bracket)
+			dirty |= OV7251_DIRTY_BRACKET;
+		if (priv->vblank->is_new)
+			dirty |= OV7251_DIRTY_VBLANK;
+		dev_dbg(&client->dev, "EXPOSURE = %u GAIN = %u VBLANK = %d\n",
+			priv->exposure_time, priv->digital_gain,
+			priv->vblank->val);
+		break;
+	case V4L2_CID_OV7251_EXT_TRIGGER: {
+		const struct ov7251_mode *mode;
+
+		/* Picked up by the MCU on the next stream-on (register 202/208) */
+		mode = ov7251_find_mode(priv->bit_depth, ctrl->val,
+					priv->cur_mode->width,
+					priv->cur_mode->height);
+		if (!mode)
+			return -EINVAL;
+		priv->ext_trig = ctrl->val;
+		priv->cur_mode = mode;
+		return 0;
+	}
+	case V4L2_CID_OV7251_TRIGGER_RATE:
+		priv->trig.rate = ctrl->val;
+		/* Restarted so the phase follows the new period */
+		if (!priv->streaming || priv->starting)
+			return 0;
+		ov7251_trigger_stop(priv);
+		return ov7251_trigger_start(priv);
+	default:
+		return -EINVAL;
+	}
 
-		ret  = reg_write(client, OV7251_AEC_AGC_ADJ_0, (gain & 0x0300) >> 8);/* goes to OV7251_AEC_AGC_ADJ_0 */
-		ret |= reg_write(client, OV7251_AEC_AGC_ADJ_1, gain & 0xff);
+	/* Cached only while stopped, stream-on replays every control */
+	if (!priv->streaming)
+		return 0;
 
+	priv->dirty |= dirty;
+
+	/*
+	 * The per-frame group is written now, with anything still pending,
+	 * so the published frame delays hold. During the stream-on
+	 * handshake the stream work replays it instead. A failed write is
+	 * returned to the caller and stays dirty, so the next write or
+	 * stream-on retries the group.
+	 */
+	if ((dirty & (OV7251_DIRTY_FRAME | OV7251_DIRTY_VBLANK)) &&
+	    !priv->starting) {
+		ret = ov7251_apply_ctrls(priv);
+		if (ret)
+			dev_err(&client->dev, "failed to apply controls: %d\n", ret);
 		return ret;
+	}
 
-	case V4L2_CID_EXPOSURE:
-
-		exposure = ctrl->val ; 
-		
-		if (exposure < OV7251_DIGITAL_EXPOSURE_MIN)
-			exposure = OV7251_DIGITAL_EXPOSURE_MIN;
-		if (exposure > OV7251_DIGITAL_EXPOSURE_MAX)
-			exposure = OV7251_DIGITAL_EXPOSURE_MAX;
-		
-		priv->exposure_time = exposure ;
-
-		dev_info(&client->dev, "EXPOSURE = %d \n",exposure);
+	/*
+	 * Coalesced with any pending change and written by ov7251_ctrl_work().
+	 * Only these deferred writes can fail after this call has returned:
+	 * they are logged, counted in debugfs "i2c" and retried with the
+	 * next change.
+	 */
+	queue_work(priv->wq, &priv->ctrl_work);
 
-		ret  = reg_write(client, OV7251_AEC_EXPO_0, (exposure & 0xf000) >> 12);
-		ret |= reg_write(client, OV7251_AEC_EXPO_1, (exposure & 0x0ff0) >> 4);
-		ret |= reg_write(client, OV7251_AEC_EXPO_2,  (exposure & 0x000f) << 4);
+	return 0;
+}
 
-		return ret;
+static int ov7251_g_volatile_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct ov7251 *priv =
+	    container_of(ctrl->handler, struct ov7251, ctrl_handler);
 
-	case V4L2_CID_VBLANK:
-		/* VTS = height + vblank */
-		ret = reg_write(client, OV7251_VTS_HIGH, ((priv->cur_mode->height + ctrl->val) >> 8) & 0xff);
-		ret |= reg_write(client, OV7251_VTS_LOW, (priv->cur_mode->height + ctrl->val) & 0xff);
-		return ret;
-	case V4L2_CID_ANALOGUE_GAIN:
-		/* reuse same gain registers as digital gain */
-		gain = ctrl->val;
-		ret  = reg_write(client, OV7251_AEC_AGC_ADJ_0, (gain & 0x0300) >> 8);
-		ret |= reg_write(client, OV7251_AEC_AGC_ADJ_1, gain & 0xff);
-		return ret;
-	default:
-		return -EINVAL;
+	switch (ctrl->id) {
+	case V4L2_CID_OV7251_FRAME_COUNT:
+		ov7251_update_counters(priv);
+		ctrl->val = priv->frames;
+		return 0;
+	case V4L2_CID_OV7251_TRIGGER_COUNT:
+		ov7251_update_counters(priv);
+		ctrl->val = priv->triggers;
+		return 0;
+	case V4L2_CID_OV7251_BRACKET_BANK:
+		ov7251_update_counters(priv);
+		/* Bank 0 until the launch frame is reached */
+		if (!priv->bracket || priv->frames < priv->bracket_start)
+			ctrl->val = 0;
+		else
+			ctrl->val = (priv->frames - priv->bracket_start) %
+				    OV7251_BRACKET_BANKS;
+		return 0;
+	case V4L2_CID_OV7251_SKIP_FRAMES:
+		/* Same as g_skip_frames, for applications without a bridge */
+		ctrl->val = priv->cur_mode->skip_frames;
+		return 0;
 	}
 
-	/* If enabled, apply settings immediately */
-	reg = reg_read(client, 0x100);
-	if ((reg & 0x1f) == 0x01)
-		ov7251_s_stream(&priv->subdev, 1);
-
-	return 0;
+	return -EINVAL;
 }
 
 static int ov7251_enum_mbus_code(struct v4l2_subdev *sd,
@@ -551,16 +1898,39 @@ static int ov7251_enum_frame_sizes(struct v4l2_subdev *sd,
 #endif
 				   struct v4l2_subdev_frame_size_enum *fse)
 {
-	if (fse->index != 0)
+	struct i2c_client *client = v4l2_get_subdevdata(sd);
+	struct ov7251 *priv = to_ov7251(client);
+	const struct ov7251_mode *mode;
+	u32 depth;
+	unsigned int i, n = 0;
+
+	if (fse->code == MEDIA_BUS_FMT_Y8_1X8)
+		depth = 8;
+	else if (fse->code == MEDIA_BUS_FMT_Y10_1X10)
+		depth = 10;
+	else
 		return -EINVAL;
-	if (fse->code != MEDIA_BUS_FMT_Y8_1X8 &&
-	    fse->code != MEDIA_BUS_FMT_Y10_1X10)
+
+	/* The bit depth is fixed per camera, only its own code has sizes */
+	if (depth != priv->bit_depth)
 		return -EINVAL;
-	fse->min_width  = OV7251_PIXEL_ARRAY_WIDTH;
-	fse->max_width  = OV7251_PIXEL_ARRAY_WIDTH;
-	fse->min_height = OV7251_PIXEL_ARRAY_HEIGHT;
-	fse->max_height = OV7251_PIXEL_ARRAY_HEIGHT;
-	return 0;
+
+	/* One entry per size of the modes this camera can switch between */
+	for (i = 0; i < ARRAY_SIZE(supported_modes); i++) {
+		mode = &supported_modes[i];
+		if (mode->sensor_depth != depth ||
+		    !!mode->sensor_ext_trig != priv->ext_trig)
+			continue;
+		if (n++ == fse->index) {
+			fse->min_width  = mode->width;
+			fse->max_width  = mode->width;
+			fse->min_height = mode->height;
+			fse->max_height = mode->height;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
 }
 
 static int ov7251_get_selection(struct v4l2_subdev *sd,
@@ -590,12 +1960,95 @@ static int ov7251_get_selection(struct v4l2_subdev *sd,
 	return -EINVAL;
 }
 
-static const struct ov7251_mode *ov7251_find_best_fit(
+/* Nearest supported size; depth and trigger are per camera, not per format */
+static const struct ov7251_mode *ov7251_find_best_fit(struct ov7251 *priv,
 					struct v4l2_subdev_format *fmt)
 {
+	const struct ov7251_mode *mode, *best = NULL;
+	u32 dist, best_dist = U32_MAX;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(supported_modes); i++) {
+		mode = &supported_modes[i];
+		if (mode->sensor_depth != priv->bit_depth ||
+		    !!mode->sensor_ext_trig != priv->ext_trig)
+			continue;
+
+		dist = abs((int)mode->width - (int)fmt->format.width) +
+		       abs((int)mode->height - (int)fmt->format.height);
+		if (dist < best_dist) {
+			best = mode;
+			best_dist = dist;
+		}
+	}
+
+	return best;
+}
+
+/* Default frame rate from DT: VTS = pixel_rate / (HTS * fps) */
+static u32 ov7251_default_vts(struct ov7251 *priv,
+			      const struct ov7251_mode *mode)
+{
+	u32 vts = mode->vts_def;
+
+	if (priv->frame_rate)
+		vts = div_u64(OV7251_PIXEL_RATE, mode->hts_def * priv->frame_rate);
+
+	return clamp_t(u32, vts, mode->height + OV7251_VTS_MIN_OFFSET,
+		       OV7251_VTS_MAX);
+}
+
+/* Called with priv->lock held, an out of range exposure is clamped */
+static int ov7251_update_exposure_range(struct ov7251 *priv)
+{
+	u32 exposure_max = ov7251_exposure_max(priv, priv->vblank->cur.val);
+
+	return __v4l2_ctrl_modify_range(priv->exposure,
+					OV7251_DIGITAL_EXPOSURE_MIN,
+					exposure_max, 1,
+					min_t(u32, OV7251_DIGITAL_EXPOSURE_DEFAULT,
+					      exposure_max));
+}
+
+/*
+ * VBLANK is in the exposure cluster, whose s_ctrl cannot change the
+ * range of its own master, so the range follows once the new VBLANK has
+ * been committed. Runs with priv->lock held.
+ */
+static void ov7251_ctrl_notify(struct v4l2_ctrl *ctrl, void *arg)
+{
+	struct ov7251 *priv = arg;
+	struct i2c_client *client = v4l2_get_subdevdata(&priv->subdev);
+	int ret;
+
+	ret = ov7251_update_exposure_range(priv);
+	if (ret)
+		dev_warn(&client->dev, "failed to clamp exposure: %d\n", ret);
+}
+
+/*
+ * Blanking and exposure limits follow the active mode's frame size, and
+ * VBLANK goes back to the default frame rate for the new size.
+ */
+static int ov7251_update_mode_ctrls(struct ov7251 *priv)
+{
+	const struct ov7251_mode *mode = priv->cur_mode;
+	u32 vblank = ov7251_default_vts(priv, mode) - mode->height;
+	u32 hblank = mode->hts_def - mode->width;
+	int ret;
+
+	ret = __v4l2_ctrl_modify_range(priv->hblank, hblank, hblank, 1, hblank);
+	if (ret)
+		return ret;
 
-	return &supported_modes[sensor_mode];
+	ret = __v4l2_ctrl_modify_range(priv->vblank, OV7251_VTS_MIN_OFFSET,
+				       OV7251_VTS_MAX - mode->height, 1, vblank);
+	ret = ret ?: __v4l2_ctrl_s_ctrl(priv->vblank, vblank);
+	if (ret)
+		return ret;
 
+	/* Still needed when VBLANK kept its value for the new height */
+	return ov7251_update_exposure_range(priv);
 }
 
 static int ov7251_set_fmt(struct v4l2_subdev *sd,
@@ -609,8 +2062,10 @@ static int ov7251_set_fmt(struct v4l2_subdev *sd,
 	struct i2c_client *client = v4l2_get_subdevdata(sd);
 	struct ov7251 *priv = to_ov7251(client);
 	const struct ov7251_mode *mode;
+	int ret = 0;
 
-	mode = ov7251_find_best_fit(fmt);
+	mutex_lock(&priv->lock);
+	mode = ov7251_find_best_fit(priv, fmt);
 	if(mode->sensor_depth==8)
 		fmt->format.code = MEDIA_BUS_FMT_Y8_1X8;
 	if(mode->sensor_depth==10)
@@ -620,10 +2075,18 @@ static int ov7251_set_fmt(struct v4l2_subdev *sd,
 	fmt->format.field = V4L2_FIELD_NONE;
 	fmt->format.colorspace = V4L2_COLORSPACE_RAW;
 
-	if (fmt->which == V4L2_SUBDEV_FORMAT_ACTIVE)
-		priv->cur_mode = mode;
+	if (fmt->which == V4L2_SUBDEV_FORMAT_ACTIVE && mode != priv->cur_mode) {
+		/* The subsampling registers are only written at stream-on */
+		if (priv->streaming) {
+			ret = -EBUSY;
+		} else {
+			priv->cur_mode = mode;
+			ret = ov7251_update_mode_ctrls(priv);
+		}
+	}
+	mutex_unlock(&priv->lock);
 
-	return 0;
+	return ret;
 }
 
 static int ov7251_get_fmt(struct v4l2_subdev *sd,
@@ -636,9 +2099,10 @@ static int ov7251_get_fmt(struct v4l2_subdev *sd,
 {
 	struct i2c_client *client = v4l2_get_subdevdata(sd);
 	struct ov7251 *priv = to_ov7251(client);
-	const struct ov7251_mode *mode = priv->cur_mode;
-	s64 pixel_rate;
+	const struct ov7251_mode *mode;
 
+	mutex_lock(&priv->lock);
+	mode = priv->cur_mode;
 	fmt->format.width = mode->width;
 	fmt->format.height = mode->height;
 	if(mode->sensor_depth==8)
@@ -647,12 +2111,7 @@ static int ov7251_get_fmt(struct v4l2_subdev *sd,
 		fmt->format.code = MEDIA_BUS_FMT_Y10_1X10;
 	fmt->format.field = V4L2_FIELD_NONE;
 	fmt->format.colorspace = V4L2_COLORSPACE_RAW;
-
-	if (fmt->which == V4L2_SUBDEV_FORMAT_ACTIVE) {
-		pixel_rate = mode->vts_def * mode->hts_def * mode->max_fps;
-		__v4l2_ctrl_modify_range(priv->pixel_rate, pixel_rate,
-					pixel_rate, 1, pixel_rate);
-	}
+	mutex_unlock(&priv->lock);
 
 	return 0;
 }
@@ -666,6 +2125,29 @@ static struct v4l2_subdev_core_ops ov7251_subdev_core_ops = {
 	.s_power = ov7251_s_power,
 };
 
+/*
+ * Controls are replayed in standby before 0x0100 is set, so the first
+ * exposure already uses them. In trigger mode every frame starts on a
+ * trigger that comes after that, so no frame is lost. Free running, the
+ * first frame can still come out of the standby exit with a short
+ * exposure and is reported as invalid.
+ */
+static int ov7251_g_skip_frames(struct v4l2_subdev *sd, u32 *frames)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(sd);
+	struct ov7251 *priv = to_ov7251(client);
+
+	mutex_lock(&priv->lock);
+	*frames = priv->cur_mode->skip_frames;
+	mutex_unlock(&priv->lock);
+
+	return 0;
+}
+
+static const struct v4l2_subdev_sensor_ops ov7251_subdev_sensor_ops = {
+	.g_skip_frames = ov7251_g_skip_frames,
+};
+
 static int ov7251_get_mbus_config(struct v4l2_subdev *sd, unsigned int pad,
 				  struct v4l2_mbus_config *cfg)
 {
@@ -688,9 +2170,11 @@ static struct v4l2_subdev_ops ov7251_subdev_ops = {
 	.core = &ov7251_subdev_core_ops,
 	.video = &ov7251_subdev_video_ops,
 	.pad = &ov7251_subdev_pad_ops,
+	.sensor = &ov7251_subdev_sensor_ops,
 };
 
 static const struct v4l2_ctrl_ops ov7251_ctrl_ops = {
+	.g_volatile_ctrl = ov7251_g_volatile_ctrl,
 	.s_ctrl = ov7251_s_ctrl,
 };
 
@@ -741,53 +2225,198 @@ static int ov7251_ctrls_init(struct v4l2_subdev *sd)
 	struct i2c_client *client = v4l2_get_subdevdata(sd);
 	struct ov7251 *priv = to_ov7251(client);
 	const struct ov7251_mode *mode = priv->cur_mode;
+	struct v4l2_ctrl_config rate_cfg = {
+		.ops	= &ov7251_ctrl_ops,
+		.id	= V4L2_CID_OV7251_TRIGGER_RATE,
+		.name	= "Trigger Rate mHz",
+		.type	= V4L2_CTRL_TYPE_INTEGER,
+		.min	= 0,
+		.max	= OV7251_TRIGGER_RATE_MAX,
+		.step	= 1,
+		.def	= 0,
+	};
+	struct v4l2_ctrl_config trig_cfg = {
+		.ops	= &ov7251_ctrl_ops,
+		.id	= V4L2_CID_OV7251_EXT_TRIGGER,
+		.name	= "External Trigger",
+		.type	= V4L2_CTRL_TYPE_BOOLEAN,
+		.min	= 0,
+		.max	= 1,
+		.step	= 1,
+		.def	= priv->ext_trig,
+	};
+	static const struct v4l2_ctrl_config strobe_cfg[] = {
+		{
+			.ops	= &ov7251_ctrl_ops,
+			.id	= V4L2_CID_OV7251_STROBE_ENABLE,
+			.name	= "Strobe Enable",
+			.type	= V4L2_CTRL_TYPE_BOOLEAN,
+			.max	= 1,
+			.step	= 1,
+		}, {
+			.ops	= &ov7251_ctrl_ops,
+			.id	= V4L2_CID_OV7251_STROBE_INVERT,
+			.name	= "Strobe Active Low",
+			.type	= V4L2_CTRL_TYPE_BOOLEAN,
+			.max	= 1,
+			.step	= 1,
+		}, {
+			.ops	= &ov7251_ctrl_ops,
+			.id	= V4L2_CID_OV7251_STROBE_WIDTH,
+			.name	= "Strobe Width Lines",
+			.type	= V4L2_CTRL_TYPE_INTEGER,
+			.max	= OV7251_STROBE_MAX,
+			.step	= 1,
+		}, {
+			.ops	= &ov7251_ctrl_ops,
+			.id	= V4L2_CID_OV7251_STROBE_OFFSET,
+			.name	= "Strobe Offset Lines",
+			.type	= V4L2_CTRL_TYPE_INTEGER,
+			.max	= OV7251_STROBE_MAX,
+			.step	= 1,
+		}, {
+			.ops	= &ov7251_ctrl_ops,
+			.id	= V4L2_CID_OV7251_FRAME_COUNT,
+			.name	= "Frames Since Stream On",
+			.type	= V4L2_CTRL_TYPE_INTEGER,
+			.max	= S32_MAX,
+			.step	= 1,
+			.flags	= V4L2_CTRL_FLAG_READ_ONLY |
+				  V4L2_CTRL_FLAG_VOLATILE,
+		}, {
+			.ops	= &ov7251_ctrl_ops,
+			.id	= V4L2_CID_OV7251_TRIGGER_COUNT,
+			.name	= "Triggers Since Stream On",
+			.type	= V4L2_CTRL_TYPE_INTEGER,
+			.max	= S32_MAX,
+			.step	= 1,
+			.flags	= V4L2_CTRL_FLAG_READ_ONLY |
+				  V4L2_CTRL_FLAG_VOLATILE,
+		}, {
+			.ops	= &ov7251_ctrl_ops,
+			.id	= V4L2_CID_OV7251_BRACKET,
+			.name	= "Exposure Bracketing",
+			.type	= V4L2_CTRL_TYPE_BOOLEAN,
+			.max	= 1,
+			.step	= 1,
+		}, {
+			.ops	= &ov7251_ctrl_ops,
+			.id	= V4L2_CID_OV7251_BRACKET_BANKS,
+			.name	= "Exposure Bracket Banks",
+			.type	= V4L2_CTRL_TYPE_U32,
+			.max	= OV7251_DIGITAL_GAIN_MAX,
+			.step	= 1,
+			.dims	= { OV7251_BRACKET_BANKS * 2 },
+		}, {
+			.ops	= &ov7251_ctrl_ops,
+			.id	= V4L2_CID_OV7251_BRACKET_BANK,
+			.name	= "Exposure Bracket Bank",
+			.type	= V4L2_CTRL_TYPE_INTEGER,
+			.max	= OV7251_BRACKET_BANKS - 1,
+			.step	= 1,
+			.flags	= V4L2_CTRL_FLAG_READ_ONLY |
+				  V4L2_CTRL_FLAG_VOLATILE,
+		}, {
+			.ops	= &ov7251_ctrl_ops,
+			.id	= V4L2_CID_OV7251_EXPOSURE_DELAY,
+			.name	= "Exposure Delay Frames",
+			.type	= V4L2_CTRL_TYPE_INTEGER,
+			.min	= OV7251_EXPOSURE_DELAY,
+			.max	= OV7251_EXPOSURE_DELAY,
+			.step	= 1,
+			.def	= OV7251_EXPOSURE_DELAY,
+			.flags	= V4L2_CTRL_FLAG_READ_ONLY,
+		}, {
+			.ops	= &ov7251_ctrl_ops,
+			.id	= V4L2_CID_OV7251_GAIN_DELAY,
+			.name	= "Gain Delay Frames",
+			.type	= V4L2_CTRL_TYPE_INTEGER,
+			.min	= OV7251_GAIN_DELAY,
+			.max	= OV7251_GAIN_DELAY,
+			.step	= 1,
+			.def	= OV7251_GAIN_DELAY,
+			.flags	= V4L2_CTRL_FLAG_READ_ONLY,
+		}, {
+			.ops	= &ov7251_ctrl_ops,
+			.id	= V4L2_CID_OV7251_VBLANK_DELAY,
+			.name	= "VBLANK Delay Frames",
+			.type	= V4L2_CTRL_TYPE_INTEGER,
+			.min	= OV7251_VBLANK_DELAY,
+			.max	= OV7251_VBLANK_DELAY,
+			.step	= 1,
+			.def	= OV7251_VBLANK_DELAY,
+			.flags	= V4L2_CTRL_FLAG_READ_ONLY,
+		}, {
+			.ops	= &ov7251_ctrl_ops,
+			.id	= V4L2_CID_OV7251_SKIP_FRAMES,
+			.name	= "Startup Skip Frames",
+			.type	= V4L2_CTRL_TYPE_INTEGER,
+			.max	= 1,
+			.step	= 1,
+			.flags	= V4L2_CTRL_FLAG_READ_ONLY |
+				  V4L2_CTRL_FLAG_VOLATILE,
+		},
+	};
 	s64 pixel_rate;
+	u32 vts, exposure_max;
+	unsigned int i;
 	int ret;
 
-	v4l2_ctrl_handler_init(&priv->ctrl_handler, 14);
+	v4l2_ctrl_handler_init(&priv->ctrl_handler, 28);
+	priv->ctrl_handler.lock = &priv->lock;
 	
 	v4l2_ctrl_new_std(&priv->ctrl_handler, &ov7251_ctrl_ops,
 			  V4L2_CID_HFLIP,0,1,1,0);
 	v4l2_ctrl_new_std(&priv->ctrl_handler, &ov7251_ctrl_ops,
 			  V4L2_CID_VFLIP,0,1,1,0);
 
-	v4l2_ctrl_new_std(&priv->ctrl_handler, &ov7251_ctrl_ops,
+	priv->gain = v4l2_ctrl_new_std(&priv->ctrl_handler, &ov7251_ctrl_ops,
 			  V4L2_CID_GAIN,
 			  OV7251_DIGITAL_GAIN_MIN,
 			  OV7251_DIGITAL_GAIN_MAX, 1,
 			  OV7251_DIGITAL_GAIN_DEFAULT);
 
-	v4l2_ctrl_new_std(&priv->ctrl_handler, &ov7251_ctrl_ops,
+	vts = ov7251_default_vts(priv, mode);
+	exposure_max = ov7251_exposure_max(priv, vts - mode->height);
+	priv->exposure = v4l2_ctrl_new_std(&priv->ctrl_handler, &ov7251_ctrl_ops,
 			  V4L2_CID_EXPOSURE,
 			  (OV7251_DIGITAL_EXPOSURE_MIN) ,
-			  (OV7251_DIGITAL_EXPOSURE_MAX), 1,
-			  (OV7251_DIGITAL_EXPOSURE_DEFAULT) );
+			  exposure_max, 1,
+			  min_t(u32, OV7251_DIGITAL_EXPOSURE_DEFAULT,
+				exposure_max));
 			  
 
 	/* freq */
 	v4l2_ctrl_new_int_menu(&priv->ctrl_handler, NULL, V4L2_CID_LINK_FREQ,
 			       0, 0, link_freq_menu_items);
-	pixel_rate = mode->vts_def * mode->hts_def * mode->max_fps;
+	pixel_rate = OV7251_PIXEL_RATE;
 	priv->pixel_rate = v4l2_ctrl_new_std(&priv->ctrl_handler, NULL, V4L2_CID_PIXEL_RATE,
 			  0, pixel_rate, 1, pixel_rate);
 
 	/* mandatory libcamera controls */
-	v4l2_ctrl_new_std(&priv->ctrl_handler, &ov7251_ctrl_ops,
+	priv->vblank = v4l2_ctrl_new_std(&priv->ctrl_handler, &ov7251_ctrl_ops,
 			  V4L2_CID_VBLANK,
 			  OV7251_VTS_MIN_OFFSET,
 			  OV7251_VTS_MAX - mode->height, 1,
-			  mode->vts_def - mode->height);
-	v4l2_ctrl_new_std(&priv->ctrl_handler, NULL,
+			  vts - mode->height);
+	priv->hblank = v4l2_ctrl_new_std(&priv->ctrl_handler, NULL,
 			  V4L2_CID_HBLANK,
 			  mode->hts_def - mode->width,
 			  mode->hts_def - mode->width, 1,
 			  mode->hts_def - mode->width);
-	v4l2_ctrl_new_std(&priv->ctrl_handler, &ov7251_ctrl_ops,
+	priv->analogue_gain = v4l2_ctrl_new_std(&priv->ctrl_handler, &ov7251_ctrl_ops,
 			  V4L2_CID_ANALOGUE_GAIN,
 			  OV7251_DIGITAL_GAIN_MIN,
 			  OV7251_DIGITAL_GAIN_MAX, 1,
 			  OV7251_DIGITAL_GAIN_DEFAULT);
 
+	priv->ext_trig_ctrl = v4l2_ctrl_new_custom(&priv->ctrl_handler,
+						   &trig_cfg, NULL);
+	for (i = 0; i < ARRAY_SIZE(strobe_cfg); i++)
+		v4l2_ctrl_new_custom(&priv->ctrl_handler, &strobe_cfg[i], NULL);
+	if (priv->trig.gpio)
+		v4l2_ctrl_new_custom(&priv->ctrl_handler, &rate_cfg, NULL);
+
 	priv->subdev.ctrl_handler = &priv->ctrl_handler;
 	if (priv->ctrl_handler.error) {
 		dev_err(&client->dev, "Error %d adding controls\n",
@@ -796,6 +2425,10 @@ static int ov7251_ctrls_init(struct v4l2_subdev *sd)
 		goto error;
 	}
 
+	/* One s_ctrl call, and one group hold, per exposure/gain/VBLANK set */
+	v4l2_ctrl_cluster(4, &priv->exposure);
+	v4l2_ctrl_notify(priv->vblank, ov7251_ctrl_notify, priv);
+
 	ret = v4l2_ctrl_handler_setup(&priv->ctrl_handler);
 	if (ret < 0) {
 		dev_err(&client->dev, "Error %d setting default controls\n",
@@ -819,6 +2452,237 @@ static int ov7251_detect(struct i2c_client *client, struct i2c_board_info *info)
 	return 0;
 }
 
+/*
+ * The overlay gives the cam0 and cam1 nodes the same pwdn-gpios, so with
+ * both cameras enabled one module power line feeds both. Gating it from
+ * either driver instance would cut power to the other camera too.
+ */
+static bool ov7251_pwdn_shared(struct device *dev)
+{
+	struct of_phandle_args mine, other;
+	struct device_node *np;
+	bool shared = false;
+
+	if (!dev->of_node ||
+	    of_parse_phandle_with_args(dev->of_node, "pwdn-gpios",
+				       "#gpio-cells", 0, &mine))
+		return false;
+
+	for_each_compatible_node(np, NULL, "ovti,ov7251") {
+		if (np == dev->of_node || !of_device_is_available(np))
+			continue;
+		if (of_parse_phandle_with_args(np, "pwdn-gpios", "#gpio-cells",
+					       0, &other))
+			continue;
+		shared = other.np == mine.np && other.args_count &&
+			 mine.args_count && other.args[0] == mine.args[0];
+		of_node_put(other.np);
+		if (shared) {
+			of_node_put(np);
+			break;
+		}
+	}
+	of_node_put(mine.np);
+
+	return shared;
+}
+
+/*
+ * Per-camera configuration. Each property is optional and falls back to the
+ * sensor_mode module parameter, so dual-camera boards can run the two
+ * sensors in different modes from the same driver:
+ *   inno,bit-depth    = <8> or <10>
+ *   inno,trigger-mode = <0> (free running) or <1> (external trigger)
+ *   inno,frame-rate   = default frame rate in fps (sets the VBLANK default)
+ *   inno,trigger-counter: the MCU firmware counts trigger pulses (210/211)
+ */
+static int ov7251_parse_dt(struct i2c_client *client, struct ov7251 *priv)
+{
+	struct device *dev = &client->dev;
+	const struct ov7251_mode *mode;
+	u32 val;
+
+	if (sensor_mode < 0 || sensor_mode >= OV7251_MCU_MODES) {
+		dev_warn(dev, "invalid sensor_mode %d, using 1\n", sensor_mode);
+		sensor_mode = 1;
+	}
+	mode = &supported_modes[sensor_mode];
+	priv->bit_depth = mode->sensor_depth;
+	priv->ext_trig = mode->sensor_ext_trig;
+
+	if (!device_property_read_u32(dev, "inno,bit-depth", &val)) {
+		if (val != 8 && val != 10) {
+			dev_err(dev, "inno,bit-depth must be 8 or 10 (got %u)\n", val);
+			return -EINVAL;
+		}
+		priv->bit_depth = val;
+	}
+
+	if (!device_property_read_u32(dev, "inno,trigger-mode", &val))
+		priv->ext_trig = !!val;
+
+	if (!device_property_read_u32(dev, "inno,frame-rate", &val))
+		priv->frame_rate = val;
+
+	/* Older firmware ACKs 210/211 too, so the read alone proves nothing */
+	priv->trig_cnt_supported = device_property_read_bool(dev,
+						"inno,trigger-counter");
+
+	priv->trig.gpio = devm_gpiod_get_optional(dev, "trigger", GPIOD_OUT_LOW);
+	if (IS_ERR(priv->trig.gpio))
+		return dev_err_probe(dev, PTR_ERR(priv->trig.gpio),
+				     "failed to get trigger gpio\n");
+	spin_lock_init(&priv->trig.log_lock);
+
+	/*
+	 * Powered from here until the end of probe, then only while
+	 * streaming (unless warm_reload is set). A line shared with the other camera, or already
+	 * claimed, is left alone and the MCU powerdown command is used.
+	 */
+	if (ov7251_pwdn_shared(dev)) {
+		dev_info(dev, "pwdn-gpios shared with another camera, using MCU powerdown\n");
+		goto no_power;
+	}
+	priv->power.pwdn = devm_gpiod_get_index_optional(dev, "pwdn", 0,
+							 GPIOD_OUT_LOW);
+	if (PTR_ERR_OR_ZERO(priv->power.pwdn) == -EBUSY) {
+		dev_warn(dev, "pwdn gpio busy, using MCU powerdown\n");
+		priv->power.pwdn = NULL;
+		goto no_power;
+	}
+	if (IS_ERR(priv->power.pwdn))
+		return dev_err_probe(dev, PTR_ERR(priv->power.pwdn),
+				     "failed to get pwdn gpio\n");
+	priv->power.led = devm_gpiod_get_index_optional(dev, "pwdn", 1,
+							GPIOD_OUT_LOW);
+	if (PTR_ERR_OR_ZERO(priv->power.led) == -EBUSY) {
+		dev_warn(dev, "led gpio busy, LED not driven\n");
+		priv->power.led = NULL;
+	}
+	if (IS_ERR(priv->power.led))
+		return dev_err_probe(dev, PTR_ERR(priv->power.led),
+				     "failed to get led gpio\n");
+	if (priv->power.pwdn) {
+		priv->power.on = true;
+		priv->power.on_time = ktime_get();
+	}
+
+no_power:
+	dev_info(dev, "config: %u-bit %s, %u fps\n", priv->bit_depth,
+		 priv->ext_trig ? "external trigger" : "streaming",
+		 priv->frame_rate ? priv->frame_rate : mode->max_fps);
+
+	return 0;
+}
+
+/*
+ * Mode and control values stay cached in priv across suspend, so resume
+ * only has to repeat what stream-on does: one MCU mode/start handshake
+ * and one replay of every control, from the same stream work.
+ */
+static int __maybe_unused ov7251_suspend(struct device *dev)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct ov7251 *priv = to_ov7251(client);
+	int ret;
+
+	priv->resume_streaming = ov7251_stop_streaming(priv, &ret);
+	if (ret)
+		dev_warn(dev, "suspend: failed to stop streaming: %d\n", ret);
+
+	/* Failing suspend over a sensor that is going unpowered helps nobody */
+	return 0;
+}
+
+static int __maybe_unused ov7251_resume(struct device *dev)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct ov7251 *priv = to_ov7251(client);
+
+	if (!priv->resume_streaming)
+		return 0;
+	priv->resume_streaming = false;
+
+	mutex_lock(&priv->lock);
+	priv->streaming = true;
+	priv->starting = true;
+	mutex_unlock(&priv->lock);
+
+	/*
+	 * Not waited for, the MCU handshake takes a few hundred ms and would
+	 * hold up the rest of the system resume. Failures are logged by the
+	 * work and leave the device stopped.
+	 */
+	queue_work(priv->wq, &priv->stream_work);
+
+	return 0;
+}
+
+static SIMPLE_DEV_PM_OPS(ov7251_pm_ops, ov7251_suspend, ov7251_resume);
+
+/*
+ * After a driver rebind the MCU usually still runs the mode it was given
+ * last time, in which case the reset and reprogram cycle in probe can be
+ * skipped. A failed read just means it is still booting, so the reads
+ * are single quiet attempts rather than the retrying helpers.
+ */
+static bool ov7251_mcu_warm(struct i2c_client *client, struct ov7251 *priv)
+{
+	int status, mode;
+
+	if (force_reset)
+		return false;
+
+	status = ov7251_mcu_peek(priv, 201);
+	if (status < 0 || !(status & 0x80) || (status & 0x01))
+		return false;
+
+	mode = ov7251_mcu_peek(priv, 202);
+	if (mode != priv->cur_mode->sensor_mode)
+		return false;
+
+	dev_info(&client->dev, "MCU already ready in MODE=%d STATUS=0x%02x\n",
+		 mode, status);
+	return true;
+}
+
+/* Power the sensor down and let the MCU program it for the default mode */
+static void ov7251_mcu_reset(struct i2c_client *client, struct ov7251 *priv)
+{
+	int i=1;
+	int addr,reg,data;
+
+	addr = 200; /* reset */
+	data = 2;   /* powerdown sensor */
+	reg = rom_write(priv->rom, addr, data);
+	msleep(100);
+
+	addr = 202; /* mode */
+	data = priv->cur_mode->sensor_mode;
+	reg = rom_write(priv->rom, addr, data);
+
+	while (1) {
+		msleep(200);
+
+		addr = 201; /* status */
+		reg = rom_read(priv->rom, addr);
+
+		if (reg >= 0 && (reg & 0x80) && !(reg & 0x01))
+			break;
+
+		if (reg < 0)
+			dev_warn(&client->dev, "MCU STATUS read failed: %d\n", reg);
+		else if (reg & 0x01)
+			dev_warn(&client->dev, "MCU error STATUS=0x%02x, retrying...\n", reg);
+
+		if (i++ > 8) {
+			dev_err(&client->dev, "MCU timeout MODE=%d STATUS=0x%02x\n", priv->cur_mode->sensor_mode, reg);
+			break;
+		}
+	}
+
+	dev_info(&client->dev, "Sensor MODE=%d PowerOn STATUS=0x%02x i=%d\n", priv->cur_mode->sensor_mode, reg, i);
+}
 
 #if LINUX_VERSION_CODE>= KERNEL_VERSION(6,6,20) 
 static int ov7251_probe(struct i2c_client *client)
@@ -841,24 +2705,50 @@ static int ov7251_probe(struct i2c_client *client,
 	priv = devm_kzalloc(&client->dev, sizeof(struct ov7251), GFP_KERNEL);
 	if (!priv)
 		return -ENOMEM;
- 	
-	/* Give MCU time to boot before probing */
-	msleep(200);
+	/* Taken by the power helpers, which already run in probe */
+	mutex_init(&priv->lock);
+	/* The transfer helpers find their counters through either client */
+	i2c_set_clientdata(client, &priv->subdev);
 
+	ret = ov7251_parse_dt(client, priv);
+	if (ret < 0)
+		return ret;
+	priv->cur_mode = ov7251_find_mode(priv->bit_depth, priv->ext_trig,
+					  OV7251_NATIVE_WIDTH,
+					  OV7251_NATIVE_HEIGHT);
+ 	
  	priv->rom = i2c_new_dummy_device(adapter,0x10);
- 	if ( priv->rom )
+ 	if ( !IS_ERR(priv->rom) )
  	{
-		static int i=1;
-		int addr,reg,data;
-		dev_info(&client->dev, "InnoMaker Camera controller found!\n");
+		int addr,reg;
+		s64 boot_us;
+		bool warm;
+
+		i2c_set_clientdata(priv->rom, &priv->subdev);
+
+		warm = ov7251_mcu_warm(client, priv);
+		/* Give MCU time to boot before probing */
+		if (!warm && priv->power.pwdn)
+			ov7251_mcu_wait_boot(priv, priv->power.on_time, &boot_us);
+		else if (!warm)
+			msleep(200);
 
 		for (addr=0; addr<sizeof(priv->rom_table); addr++)
 		{
 	          reg = rom_read(priv->rom, addr);
+		  if (reg < 0)
+			  break;
 		  *((char *)(&(priv->rom_table))+addr)=(char)reg;
 		  dev_dbg(&client->dev, "addr=0x%04x reg=0x%02x\n",addr,reg);
 		}
 
+		if (reg < 0) {
+			dev_err(&client->dev, "NOTE !!!  External Camera controller  not found !!! (%d)\n", reg);
+			ret = -EIO;
+			goto err_rom;
+		}
+		dev_info(&client->dev, "InnoMaker Camera controller found!\n");
+
 		dev_info(&client->dev, "[ MAGIC  ] [ %s ]\n",
 				priv->rom_table.magic);
 
@@ -878,41 +2768,14 @@ static int ov7251_probe(struct i2c_client *client,
 				priv->rom_table.nr_modes,
 				priv->rom_table.bytes_per_mode);
 
-		addr = 200; /* reset */
-		data = 2;   /* powerdown sensor */
-		reg = rom_write(priv->rom, addr, data);
-		msleep(100);
-
-		addr = 202; /* mode */
-		data = sensor_mode;
-		reg = rom_write(priv->rom, addr, data);
-
-		while (1) {
-			msleep(200);
-
-			addr = 201; /* status */
-			reg = rom_read(priv->rom, addr);
-
-			if ((reg & 0x80) && !(reg & 0x01))
-				break;
-
-			if (reg & 0x01)
-				dev_warn(&client->dev, "MCU error STATUS=0x%02x, retrying...\n", reg);
-
-			if (i++ > 8) {
-				dev_err(&client->dev, "MCU timeout MODE=%d STATUS=0x%02x\n", sensor_mode, reg);
-				break;
-			}
-		}
-
-		dev_info(&client->dev, "Sensor MODE=%d PowerOn STATUS=0x%02x i=%d\n", sensor_mode, reg, i);
-
+		if (!warm)
+			ov7251_mcu_reset(client, priv);
 	}
 	else
 	{
 		dev_err(&client->dev, "NOTE !!!  External Camera controller  not found !!!\n");
-		dev_info(&client->dev, "Sensor MODE=%d \n",sensor_mode);
-		return -EIO;
+		dev_info(&client->dev, "Sensor MODE=%d \n",priv->cur_mode->sensor_mode);
+		return PTR_ERR(priv->rom);
 	}
 
 	/* Read PLL registers to determine actual MIPI link frequency */
@@ -927,16 +2790,23 @@ static int ov7251_probe(struct i2c_client *client,
 			 pll1_pre_div, pll1_mult, pll1_div, pll1_pix_div, pll1_mipi_div);
 	}
 
-	/* 640 * 480 by default */
-	priv->cur_mode = &supported_modes[sensor_mode];
+	INIT_WORK(&priv->stream_work, ov7251_stream_work);
+	INIT_WORK(&priv->ctrl_work, ov7251_ctrl_work);
+	INIT_DELAYED_WORK(&priv->counter_work, ov7251_counter_work);
+	priv->wq = alloc_ordered_workqueue("ov7251-%s", 0, dev_name(&client->dev));
+	if (!priv->wq) {
+		ret = -ENOMEM;
+		goto err_rom;
+	}
 
 	v4l2_i2c_subdev_init(&priv->subdev, client, &ov7251_subdev_ops);
 	ret = v4l2_subdev_init_finalize(&priv->subdev);
 	if (ret < 0)
-		return ret;
+		goto err_wq;
+	/* Frees the handler itself on failure */
 	ret = ov7251_ctrls_init(&priv->subdev);
 	if (ret < 0)
-		return ret;
+		goto err_subdev;
 
 	/* Skip direct sensor chip-ID read — on Pi5 the OV7251 I2C is behind
 	 * the MCU and not directly accessible.  MCU STATUS=0x80 already
@@ -944,7 +2814,7 @@ static int ov7251_probe(struct i2c_client *client,
 	if (!priv->rom) {
 		ret = ov7251_video_probe(client);
 		if (ret < 0)
-			return ret;
+			goto err_ctrls;
 	} else {
 		dev_info(&client->dev,
 			 "MCU present — skipping direct sensor chip-ID check\n");
@@ -956,12 +2826,49 @@ static int ov7251_probe(struct i2c_client *client,
 	priv->subdev.entity.function = MEDIA_ENT_F_CAM_SENSOR;
 	ret = media_entity_pads_init(&priv->subdev.entity, 1, &priv->pad);
 	if (ret < 0)
-		return ret;
+		goto err_ctrls;
 
 	ret = v4l2_async_register_subdev(&priv->subdev);
 	if (ret < 0)
-		return ret;
+		goto err_entity;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,5,0)
+	priv->debugfs = debugfs_create_dir("ov7251", client->debugfs);
+#else
+	priv->debugfs = debugfs_create_dir(dev_name(&client->dev), NULL);
+#endif
+	debugfs_create_file("counters", 0444, priv->debugfs, priv,
+			    &ov7251_counters_fops);
+	debugfs_create_file("i2c", 0444, priv->debugfs, priv,
+			    &ov7251_i2c_stats_fops);
+	if (priv->trig.gpio)
+		debugfs_create_file("trigger", 0444, priv->debugfs, priv,
+				    &ov7251_trigger_fops);
+	if (priv->power.pwdn)
+		debugfs_create_file("power", 0444, priv->debugfs, priv,
+				    &ov7251_power_fops);
+
+	/*
+	 * Idle until the first stream-on. With warm_reload the MCU keeps
+	 * running its mode, so a driver reload can skip the reset (see
+	 * ov7251_mcu_warm()).
+	 */
+	if (!warm_reload)
+		ov7251_power_down(priv);
 
+	return 0;
+
+err_entity:
+	media_entity_cleanup(&priv->subdev.entity);
+err_ctrls:
+	v4l2_ctrl_handler_free(&priv->ctrl_handler);
+err_subdev:
+	v4l2_subdev_cleanup(&priv->subdev);
+err_wq:
+	destroy_workqueue(priv->wq);
+err_rom:
+	i2c_unregister_device(priv->rom);
+	mutex_destroy(&priv->lock);
 	return ret;
 }
 #if LINUX_VERSION_CODE>= KERNEL_VERSION(6,1,0)
@@ -971,13 +2878,21 @@ static int ov7251_remove(struct i2c_client *client)
 #endif
 {
 	struct ov7251 *priv = to_ov7251(client);
+	int ret;
 
+	debugfs_remove_recursive(priv->debugfs);
+	v4l2_async_unregister_subdev(&priv->subdev);
+	/* Unbinding mid-stream: stop it like s_stream(0) would */
+	if (!ov7251_stop_streaming(priv, &ret) && !warm_reload)
+		ov7251_power_down(priv);
+	/* Drains any pending register writes before the MCU client goes */
+	destroy_workqueue(priv->wq);
 	if(priv->rom)
 		i2c_unregister_device(priv->rom);
-	v4l2_async_unregister_subdev(&priv->subdev);
 	v4l2_subdev_cleanup(&priv->subdev);
 	media_entity_cleanup(&priv->subdev.entity);
 	v4l2_ctrl_handler_free(&priv->ctrl_handler);
+	mutex_destroy(&priv->lock);
 #if LINUX_VERSION_CODE>= KERNEL_VERSION(6,1,0) 
     return;
 #else	
@@ -1001,6 +2916,7 @@ static struct i2c_driver ov7251_i2c_driver = {
 	.driver = {
 		.of_match_table = of_match_ptr(ov7251_of_match),
 		.name = "inno_mipi_ov7251",
+		.pm = &ov7251_pm_ops,
 	},
 	.probe = ov7251_probe,
 	.remove = ov7251_remove,
@@ -0,0 +1,78 @@
+/*
+ * Lock-free single-producer single-consumer ring buffer
+ *
+ * Copyright (C) 2022 SHENZHEN InnoMaker
+ *
+ * One thread may push() and one other thread may front()/pop(). The
+ * capacity is rounded up to a power of two.
+ */
+
+#ifndef OV7251_TOOLS_SPSC_QUEUE_H
+#define OV7251_TOOLS_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace ov7251 {
+
+template<typename T>
+class SpscQueue {
+public:
+	explicit SpscQueue(size_t capacity)
+	{
+		size_t size = 1;
+
+		while (size < capacity)
+			size <<= 1;
+		slots_.resize(size);
+		mask_ = size - 1;
+	}
+
+	SpscQueue(const SpscQueue &) = delete;
+	SpscQueue &operator=(const SpscQueue &) = delete;
+
+	/* Producer side. Returns false when full. */
+	bool push(const T &value)
+	{
+		size_t head = head_.load(std::memory_order_relaxed);
+
+		if (head - tail_.load(std::memory_order_acquire) > mask_)
+			return false;
+
+		slots_[head & mask_] = value;
+		head_.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* Consumer side. Returns nullptr when empty. */
+	T *front()
+	{
+		size_t tail = tail_.load(std::memory_order_relaxed);
+
+		if (tail == head_.load(std::memory_order_acquire))
+			return nullptr;
+
+		return &slots_[tail & mask_];
+	}
+
+	void pop()
+	{
+		tail_.store(tail_.load(std::memory_order_relaxed) + 1,
+			    std::memory_order_release);
+	}
+
+	size_t capacity() const { return mask_ + 1; }
+
+private:
+	std::vector<T> slots_;
+	size_t mask_ = 0;
+
+	/* Separate cache lines so producer and consumer do not false-share */
+	alignas(64) std::atomic<size_t> head_{ 0 };
+	alignas(64) std::atomic<size_t> tail_{ 0 };
+};
+
+} /* namespace ov7251 */
+
+#endif /* OV7251_TOOLS_SPSC_QUEUE_H */
@@ -0,0 +1,71 @@
+/*
+ * Small statistics helpers for the InnoMaker MIPI OV7251 tools
+ *
+ * Copyright (C) 2022 SHENZHEN InnoMaker
+ */
+
+#ifndef OV7251_TOOLS_STATS_H
+#define OV7251_TOOLS_STATS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace ov7251 {
+
+/* Collects samples and reports nearest-rank percentiles. */
+class Samples {
+public:
+	void reserve(size_t n) { values_.reserve(n); }
+	void add(double v) { values_.push_back(v); sorted_ = false; }
+	size_t count() const { return values_.size(); }
+	bool empty() const { return values_.empty(); }
+
+	double percentile(double p)
+	{
+		if (values_.empty())
+			return 0.0;
+		sort();
+		size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * values_.size()));
+		rank = std::clamp<size_t>(rank, 1, values_.size());
+		return values_[rank - 1];
+	}
+
+	double min() { return percentile(0); }
+	double max() { return percentile(100); }
+
+	double mean() const
+	{
+		double sum = 0.0;
+
+		for (double v : values_)
+			sum += v;
+		return values_.empty() ? 0.0 : sum / values_.size();
+	}
+
+	double stddev() const
+	{
+		double m = mean(), acc = 0.0;
+
+		for (double v : values_)
+			acc += (v - m) * (v - m);
+		return values_.size() < 2 ? 0.0 : std::sqrt(acc / (values_.size() - 1));
+	}
+
+private:
+	void sort()
+	{
+		if (!sorted_) {
+			std::sort(values_.begin(), values_.end());
+			sorted_ = true;
+		}
+	}
+
+	std::vector<double> values_;
+	bool sorted_ = true;
+};
+
+} /* namespace ov7251 */
+
+#endif /* OV7251_TOOLS_STATS_H */
@@ -0,0 +1,401 @@
+/*
+ * V4L2 streaming capture helper for the InnoMaker MIPI OV7251 tools
+ *
+ * Copyright (C) 2022 SHENZHEN InnoMaker
+ */
+
+#include "v4l2_capture.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <system_error>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <linux/videodev2.h>
+
+namespace ov7251 {
+
+namespace {
+
+[[noreturn]] void throwErrno(const std::string &what)
+{
+	throw std::system_error(errno, std::generic_category(), what);
+}
+
+int xioctl(int fd, unsigned long req, void *arg)
+{
+	int ret;
+
+	do {
+		ret = ioctl(fd, req, arg);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret;
+}
+
+bool isMplane(uint32_t type)
+{
+	return type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+}
+
+} /* namespace */
+
+int64_t monotonicNs()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+std::string fourccToString(uint32_t fourcc)
+{
+	std::string s(4, ' ');
+
+	for (int i = 0; i < 4; i++)
+		s[i] = static_cast<char>((fourcc >> (8 * i)) & 0xff);
+	return s;
+}
+
+uint32_t stringToFourcc(const std::string &str)
+{
+	uint32_t fourcc = 0;
+
+	for (size_t i = 0; i < 4; i++) {
+		uint8_t c = i < str.size() ? str[i] : ' ';
+		fourcc |= static_cast<uint32_t>(c) << (8 * i);
+	}
+	return fourcc;
+}
+
+V4l2Capture::~V4l2Capture()
+{
+	close();
+}
+
+void V4l2Capture::open(const std::string &path)
+{
+	struct v4l2_capability cap = {};
+
+	close();
+
+	fd_ = ::open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd_ < 0)
+		throwErrno("open " + path);
+	path_ = path;
+
+	if (xioctl(fd_, VIDIOC_QUERYCAP, &cap) < 0)
+		throwErrno("VIDIOC_QUERYCAP " + path);
+
+	uint32_t caps = cap.capabilities & V4L2_CAP_DEVICE_CAPS ?
+			cap.device_caps : cap.capabilities;
+	if (!(caps & V4L2_CAP_STREAMING))
+		throw std::system_error(ENOTSUP, std::generic_category(),
+					path + " does not support streaming");
+
+	if (caps & V4L2_CAP_VIDEO_CAPTURE)
+		type_ = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	else if (caps & V4L2_CAP_VIDEO_CAPTURE_MPLANE)
+		type_ = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	else
+		throw std::system_error(ENOTSUP, std::generic_category(),
+					path + " is not a capture device");
+}
+
+void V4l2Capture::close()
+{
+	if (fd_ < 0)
+		return;
+
+	if (streaming_) {
+		try {
+			stop();
+		} catch (const std::system_error &) {
+		}
+	}
+	release();
+	::close(fd_);
+	fd_ = -1;
+}
+
+Format V4l2Capture::format() const
+{
+	struct v4l2_format fmt = {};
+	Format f;
+
+	fmt.type = type_;
+	if (xioctl(fd_, VIDIOC_G_FMT, &fmt) < 0)
+		throwErrno("VIDIOC_G_FMT");
+
+	if (isMplane(type_)) {
+		f.width = fmt.fmt.pix_mp.width;
+		f.height = fmt.fmt.pix_mp.height;
+		f.pixelformat = fmt.fmt.pix_mp.pixelformat;
+		f.bytesperline = fmt.fmt.pix_mp.plane_fmt[0].bytesperline;
+		f.sizeimage = fmt.fmt.pix_mp.plane_fmt[0].sizeimage;
+	} else {
+		f.width = fmt.fmt.pix.width;
+		f.height = fmt.fmt.pix.height;
+		f.pixelformat = fmt.fmt.pix.pixelformat;
+		f.bytesperline = fmt.fmt.pix.bytesperline;
+		f.sizeimage = fmt.fmt.pix.sizeimage;
+	}
+
+	return f;
+}
+
+Format V4l2Capture::setFormat(uint32_t width, uint32_t height,
+			      uint32_t pixelformat)
+{
+	struct v4l2_format fmt = {};
+
+	fmt.type = type_;
+	if (xioctl(fd_, VIDIOC_G_FMT, &fmt) < 0)
+		throwErrno("VIDIOC_G_FMT");
+
+	if (isMplane(type_)) {
+		if (width)
+			fmt.fmt.pix_mp.width = width;
+		if (height)
+			fmt.fmt.pix_mp.height = height;
+		if (pixelformat)
+			fmt.fmt.pix_mp.pixelformat = pixelformat;
+		fmt.fmt.pix_mp.num_planes = 1;
+		fmt.fmt.pix_mp.plane_fmt[0].bytesperline = 0;
+		fmt.fmt.pix_mp.plane_fmt[0].sizeimage = 0;
+	} else {
+		if (width)
+			fmt.fmt.pix.width = width;
+		if (height)
+			fmt.fmt.pix.height = height;
+		if (pixelformat)
+			fmt.fmt.pix.pixelformat = pixelformat;
+		fmt.fmt.pix.bytesperline = 0;
+		fmt.fmt.pix.sizeimage = 0;
+	}
+
+	if (xioctl(fd_, VIDIOC_S_FMT, &fmt) < 0)
+		throwErrno("VIDIOC_S_FMT");
+
+	return format();
+}
+
+void V4l2Capture::allocate(unsigned int count)
+{
+	struct v4l2_requestbuffers req = {};
+
+	release();
+
+	req.count = count;
+	req.type = type_;
+	req.memory = V4L2_MEMORY_MMAP;
+	if (xioctl(fd_, VIDIOC_REQBUFS, &req) < 0)
+		throwErrno("VIDIOC_REQBUFS");
+	if (req.count == 0)
+		throw std::system_error(ENOMEM, std::generic_category(),
+					"no buffers allocated");
+
+	buffers_.resize(req.count);
+	for (unsigned int i = 0; i < req.count; i++) {
+		struct v4l2_plane planes[VIDEO_MAX_PLANES] = {};
+		struct v4l2_buffer buf = {};
+		struct v4l2_exportbuffer exp = {};
+		Buffer &b = buffers_[i];
+		off_t offset;
+
+		buf.index = i;
+		buf.type = type_;
+		buf.memory = V4L2_MEMORY_MMAP;
+		if (isMplane(type_)) {
+			buf.m.planes = planes;
+			buf.length = VIDEO_MAX_PLANES;
+		}
+		if (xioctl(fd_, VIDIOC_QUERYBUF, &buf) < 0)
+			throwErrno("VIDIOC_QUERYBUF");
+
+		if (isMplane(type_)) {
+			b.length = planes[0].length;
+			offset = planes[0].m.mem_offset;
+		} else {
+			b.length = buf.length;
+			offset = buf.m.offset;
+		}
+
+		b.mem = mmap(nullptr, b.length, PROT_READ, MAP_SHARED, fd_,
+			     offset);
+		if (b.mem == MAP_FAILED) {
+			b.mem = nullptr;
+			throwErrno("mmap");
+		}
+
+		/* Not every driver can export, the mapping is enough then */
+		exp.type = type_;
+		exp.index = i;
+		exp.plane = 0;
+		exp.flags = O_RDONLY | O_CLOEXEC;
+		if (xioctl(fd_, VIDIOC_EXPBUF, &exp) == 0)
+			b.dmabuf_fd = exp.fd;
+	}
+}
+
+void V4l2Capture::release()
+{
+	struct v4l2_requestbuffers req = {};
+
+	if (buffers_.empty())
+		return;
+
+	for (Buffer &b : buffers_) {
+		if (b.mem)
+			munmap(b.mem, b.length);
+		if (b.dmabuf_fd >= 0)
+			::close(b.dmabuf_fd);
+	}
+	buffers_.clear();
+
+	req.count = 0;
+	req.type = type_;
+	req.memory = V4L2_MEMORY_MMAP;
+	xioctl(fd_, VIDIOC_REQBUFS, &req);
+}
+
+void V4l2Capture::queue(unsigned int index)
+{
+	struct v4l2_plane planes[VIDEO_MAX_PLANES] = {};
+	struct v4l2_buffer buf = {};
+
+	buf.index = index;
+	buf.type = type_;
+	buf.memory = V4L2_MEMORY_MMAP;
+	if (isMplane(type_)) {
+		buf.m.planes = planes;
+		buf.length = 1;
+	}
+	if (xioctl(fd_, VIDIOC_QBUF, &buf) < 0)
+		throwErrno("VIDIOC_QBUF");
+}
+
+void V4l2Capture::start()
+{
+	int type = type_;
+
+	for (unsigned int i = 0; i < buffers_.size(); i++)
+		queue(i);
+
+	if (xioctl(fd_, VIDIOC_STREAMON, &type) < 0)
+		throwErrno("VIDIOC_STREAMON");
+	streaming_ = true;
+}
+
+void V4l2Capture::stop()
+{
+	int type = type_;
+
+	streaming_ = false;
+	if (xioctl(fd_, VIDIOC_STREAMOFF, &type) < 0)
+		throwErrno("VIDIOC_STREAMOFF");
+}
+
+bool V4l2Capture::dequeue(Frame &frame, int timeout_ms)
+{
+	struct v4l2_plane planes[VIDEO_MAX_PLANES] = {};
+	struct v4l2_buffer buf = {};
+	struct pollfd pfd = { fd_, POLLIN, 0 };
+	int ret;
+
+	ret = poll(&pfd, 1, timeout_ms);
+	if (ret < 0) {
+		if (errno == EINTR)
+			return false;
+		throwErrno("poll");
+	}
+	if (ret == 0)
+		return false;
+
+	buf.type = type_;
+	buf.memory = V4L2_MEMORY_MMAP;
+	if (isMplane(type_)) {
+		buf.m.planes = planes;
+		buf.length = VIDEO_MAX_PLANES;
+	}
+	if (xioctl(fd_, VIDIOC_DQBUF, &buf) < 0) {
+		if (errno == EAGAIN)
+			return false;
+		throwErrno("VIDIOC_DQBUF");
+	}
+
+	const Buffer &b = buffers_[buf.index];
+
+	frame.index = buf.index;
+	frame.sequence = buf.sequence;
+	frame.timestamp_ns = static_cast<int64_t>(buf.timestamp.tv_sec) *
+			     1000000000LL + buf.timestamp.tv_usec * 1000LL;
+	/* Only then is it comparable with dequeue_ns */
+	frame.monotonic = (buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+			  V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+	frame.dequeue_ns = monotonicNs();
+	frame.bytesused = isMplane(type_) ? planes[0].bytesused : buf.bytesused;
+	frame.data = static_cast<const uint8_t *>(b.mem);
+	frame.dmabuf_fd = b.dmabuf_fd;
+
+	return true;
+}
+
+void V4l2Capture::requeue(const Frame &frame)
+{
+	queue(frame.index);
+}
+
+V4l2Subdev::~V4l2Subdev()
+{
+	if (fd_ >= 0)
+		::close(fd_);
+}
+
+void V4l2Subdev::open(const std::string &path)
+{
+	if (fd_ >= 0)
+		::close(fd_);
+
+	fd_ = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+	if (fd_ < 0)
+		throwErrno("open " + path);
+}
+
+bool V4l2Subdev::getControl(uint32_t id, int64_t &value) const
+{
+	struct v4l2_ext_control ctrl = {};
+	struct v4l2_ext_controls ctrls = {};
+
+	ctrl.id = id;
+	ctrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+	ctrls.count = 1;
+	ctrls.controls = &ctrl;
+	if (fd_ < 0 || xioctl(fd_, VIDIOC_G_EXT_CTRLS, &ctrls) < 0)
+		return false;
+
+	value = ctrl.value;
+	return true;
+}
+
+bool V4l2Subdev::setControl(uint32_t id, int64_t value)
+{
+	struct v4l2_ext_control ctrl = {};
+	struct v4l2_ext_controls ctrls = {};
+
+	ctrl.id = id;
+	ctrl.value = static_cast<int32_t>(value);
+	ctrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+	ctrls.count = 1;
+	ctrls.controls = &ctrl;
+
+	return fd_ >= 0 && xioctl(fd_, VIDIOC_S_EXT_CTRLS, &ctrls) == 0;
+}
+
+} /* namespace ov7251 */
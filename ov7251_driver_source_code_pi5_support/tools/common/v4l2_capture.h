@@ -0,0 +1,122 @@
+/*
+ * V4L2 streaming capture helper for the InnoMaker MIPI OV7251 tools
+ *
+ * Copyright (C) 2022 SHENZHEN InnoMaker
+ *
+ * Streams from a single-planar or multi-planar capture node (rp1-cfe,
+ * unicam, vivid, ...) using MMAP buffers that are also exported as DMABUF
+ * file descriptors, so frames can be handed to other devices without
+ * copying.
+ */
+
+#ifndef OV7251_TOOLS_V4L2_CAPTURE_H
+#define OV7251_TOOLS_V4L2_CAPTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ov7251 {
+
+/* One dequeued buffer. Owned by the capture until requeue() is called. */
+struct Frame {
+	unsigned int index = 0;
+	uint32_t sequence = 0;
+	int64_t timestamp_ns = 0;	/* buffer timestamp */
+	bool monotonic = false;		/* timestamp_ns is CLOCK_MONOTONIC */
+	int64_t dequeue_ns = 0;		/* CLOCK_MONOTONIC when dequeued */
+	uint32_t bytesused = 0;
+	const uint8_t *data = nullptr;	/* read-only mapping of the buffer */
+	int dmabuf_fd = -1;		/* exported DMABUF, owned by the capture */
+};
+
+struct Format {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t pixelformat = 0;
+	uint32_t bytesperline = 0;
+	uint32_t sizeimage = 0;
+};
+
+class V4l2Capture {
+public:
+	V4l2Capture() = default;
+	~V4l2Capture();
+
+	V4l2Capture(const V4l2Capture &) = delete;
+	V4l2Capture &operator=(const V4l2Capture &) = delete;
+
+	/* All methods throw std::system_error on failure. */
+	void open(const std::string &path);
+	void close();
+
+	Format format() const;
+	/* Zero fields keep the current value. */
+	Format setFormat(uint32_t width, uint32_t height, uint32_t pixelformat);
+
+	void allocate(unsigned int count);
+	void start();
+	void stop();
+
+	/* Wait up to timeout_ms for a frame, returns false on timeout. */
+	bool dequeue(Frame &frame, int timeout_ms);
+	void requeue(const Frame &frame);
+
+	const std::string &path() const { return path_; }
+	unsigned int bufferCount() const { return buffers_.size(); }
+	bool dmabufExported() const
+	{
+		return !buffers_.empty() && buffers_[0].dmabuf_fd >= 0;
+	}
+	int fd() const { return fd_; }
+
+private:
+	struct Buffer {
+		void *mem = nullptr;
+		size_t length = 0;
+		int dmabuf_fd = -1;
+	};
+
+	void queue(unsigned int index);
+	void release();
+
+	std::string path_;
+	int fd_ = -1;
+	uint32_t type_ = 0;
+	bool streaming_ = false;
+	std::vector<Buffer> buffers_;
+};
+
+/* Control access on the sensor subdev (/dev/v4l-subdevN). */
+class V4l2Subdev {
+public:
+	V4l2Subdev() = default;
+	~V4l2Subdev();
+
+	V4l2Subdev(const V4l2Subdev &) = delete;
+	V4l2Subdev &operator=(const V4l2Subdev &) = delete;
+
+	void open(const std::string &path);
+	/* Returns false if the control does not exist on this subdev. */
+	bool getControl(uint32_t id, int64_t &value) const;
+	bool setControl(uint32_t id, int64_t value);
+
+	bool isOpen() const { return fd_ >= 0; }
+
+private:
+	int fd_ = -1;
+};
+
+/* Driver private controls, see inno_mipi_ov7251.c */
+constexpr uint32_t kCidOv7251Base = 0x00980900 | 0xf000;
+constexpr uint32_t kCidFrameCount = kCidOv7251Base + 5;
+constexpr uint32_t kCidTriggerCount = kCidOv7251Base + 6;
+
+int64_t monotonicNs();
+std::string fourccToString(uint32_t fourcc);
+uint32_t stringToFourcc(const std::string &str);
+
+} /* namespace ov7251 */
+
+#endif /* OV7251_TOOLS_V4L2_CAPTURE_H */
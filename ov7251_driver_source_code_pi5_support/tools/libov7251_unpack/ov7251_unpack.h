@@ -0,0 +1,78 @@
+/*
+ * libov7251_unpack - CSI-2 packed RAW10 (V4L2_PIX_FMT_Y10P) unpacking
+ *
+ * Copyright (C) 2022 SHENZHEN InnoMaker
+ *
+ * In the 10-bit modes (sensor_mode 0 and 2) the receiver writes frames as
+ * CSI-2 packed RAW10: every 4 pixels take 5 bytes, the first 4 holding
+ * bits 9:2 of each pixel and the fifth the two low bits of all four
+ * (pixel 0 in bits 1:0, ..., pixel 3 in bits 7:6).
+ *
+ * The converters pick SSSE3/AVX2 (x86) or NEON (AArch64) kernels at run
+ * time and fall back to portable scalar code. All functions are
+ * thread-safe and return 0 or a negative errno value.
+ */
+
+#ifndef OV7251_UNPACK_H
+#define OV7251_UNPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum ov7251_unpack_isa {
+	OV7251_UNPACK_ISA_AUTO = 0,	/* best one the CPU supports */
+	OV7251_UNPACK_ISA_SCALAR,
+	OV7251_UNPACK_ISA_SSSE3,
+	OV7251_UNPACK_ISA_AVX2,
+	OV7251_UNPACK_ISA_NEON,
+};
+
+/* Region of interest in pixels, any alignment. NULL means full frame. */
+struct ov7251_unpack_roi {
+	unsigned int x;
+	unsigned int y;
+	unsigned int width;
+	unsigned int height;
+};
+
+/* ov7251_y10p_to_y16() flags */
+#define OV7251_UNPACK_MSB_ALIGN		(1U << 0)	/* output v << 6 (Y16) instead of Y10 */
+
+/* Select the kernels used by all converters; -ENOTSUP if unavailable. */
+int ov7251_unpack_set_isa(enum ov7251_unpack_isa isa);
+enum ov7251_unpack_isa ov7251_unpack_get_isa(void);
+int ov7251_unpack_isa_supported(enum ov7251_unpack_isa isa);
+const char *ov7251_unpack_isa_name(enum ov7251_unpack_isa isa);
+
+/*
+ * src_stride and dst_stride are in bytes. width must be a multiple of 4
+ * as required by the packed format. The output starts at dst and has the
+ * size of the ROI (or of the frame when roi is NULL).
+ */
+int ov7251_y10p_to_y16(const uint8_t *src, size_t src_stride,
+		       unsigned int width, unsigned int height,
+		       uint16_t *dst, size_t dst_stride,
+		       const struct ov7251_unpack_roi *roi, unsigned int flags);
+
+/* 8-bit output as min(v >> shift, 255), shift 0..2; shift 2 keeps bits 9:2. */
+int ov7251_y10p_to_y8(const uint8_t *src, size_t src_stride,
+		      unsigned int width, unsigned int height,
+		      uint8_t *dst, size_t dst_stride,
+		      const struct ov7251_unpack_roi *roi, unsigned int shift);
+
+/* 8-bit output through a 1024-entry lookup table (gamma, contrast, ...). */
+int ov7251_y10p_to_y8_lut(const uint8_t *src, size_t src_stride,
+			  unsigned int width, unsigned int height,
+			  uint8_t *dst, size_t dst_stride,
+			  const struct ov7251_unpack_roi *roi,
+			  const uint8_t lut[1024]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OV7251_UNPACK_H */
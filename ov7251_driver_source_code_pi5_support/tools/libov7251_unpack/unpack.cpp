@@ -0,0 +1,292 @@
+/*
+ * libov7251_unpack - scalar kernels, dispatch and frame/ROI iteration
+ *
+ * Copyright (C) 2022 SHENZHEN InnoMaker
+ */
+
+#include "ov7251_unpack.h"
+#include "unpack_internal.h"
+
+#include <atomic>
+#include <cerrno>
+
+namespace ov7251 {
+
+void scalarRowY16(const uint8_t *src, uint16_t *dst, unsigned int groups,
+		  unsigned int lshift)
+{
+	for (unsigned int g = 0; g < groups; g++, src += 5, dst += 4) {
+		for (unsigned int i = 0; i < 4; i++)
+			dst[i] = static_cast<uint16_t>(y10pPixel(src, i) << lshift);
+	}
+}
+
+void scalarRowY8(const uint8_t *src, uint8_t *dst, unsigned int groups,
+		 unsigned int rshift)
+{
+	for (unsigned int g = 0; g < groups; g++, src += 5, dst += 4) {
+		for (unsigned int i = 0; i < 4; i++)
+			dst[i] = saturate8(y10pPixel(src, i) >> rshift);
+	}
+}
+
+namespace {
+
+const UnpackKernels scalar_kernels = { scalarRowY16, scalarRowY8 };
+
+const UnpackKernels *kernelsFor(enum ov7251_unpack_isa isa)
+{
+	switch (isa) {
+	case OV7251_UNPACK_ISA_SCALAR:
+		return &scalar_kernels;
+	case OV7251_UNPACK_ISA_SSSE3:
+		return ssse3Kernels();
+	case OV7251_UNPACK_ISA_AVX2:
+		return avx2Kernels();
+	case OV7251_UNPACK_ISA_NEON:
+		return neonKernels();
+	default:
+		return nullptr;
+	}
+}
+
+enum ov7251_unpack_isa bestIsa()
+{
+	static const enum ov7251_unpack_isa order[] = {
+		OV7251_UNPACK_ISA_AVX2,
+		OV7251_UNPACK_ISA_NEON,
+		OV7251_UNPACK_ISA_SSSE3,
+	};
+
+	for (enum ov7251_unpack_isa isa : order) {
+		if (kernelsFor(isa))
+			return isa;
+	}
+	return OV7251_UNPACK_ISA_SCALAR;
+}
+
+std::atomic<int> current_isa{ OV7251_UNPACK_ISA_AUTO };
+
+enum ov7251_unpack_isa activeIsa()
+{
+	int isa = current_isa.load(std::memory_order_relaxed);
+
+	if (isa == OV7251_UNPACK_ISA_AUTO) {
+		isa = bestIsa();
+		current_isa.store(isa, std::memory_order_relaxed);
+	}
+	return static_cast<enum ov7251_unpack_isa>(isa);
+}
+
+int checkArgs(const uint8_t *src, size_t src_stride, unsigned int width,
+	      unsigned int height, const void *dst,
+	      const struct ov7251_unpack_roi *roi,
+	      struct ov7251_unpack_roi &out)
+{
+	if (!src || !dst || !width || !height || width % 4 ||
+	    src_stride < width / 4 * 5)
+		return -EINVAL;
+
+	if (!roi) {
+		out = { 0, 0, width, height };
+		return 0;
+	}
+
+	if (!roi->width || !roi->height || roi->x >= width ||
+	    roi->y >= height || roi->width > width - roi->x ||
+	    roi->height > height - roi->y)
+		return -EINVAL;
+
+	out = *roi;
+	return 0;
+}
+
+/*
+ * Convert one ROI row. Pixels before the first group boundary and after
+ * the last full group go through the scalar per-pixel path, the rest
+ * through the selected kernel.
+ */
+template<typename T, typename Kernel, typename Pixel>
+void convertRow(const uint8_t *row, T *dst, unsigned int x, unsigned int w,
+		Kernel kernel, Pixel pixel)
+{
+	unsigned int end = x + w;
+
+	while (x < end && x % 4) {
+		*dst++ = pixel(row + x / 4 * 5, x % 4);
+		x++;
+	}
+
+	unsigned int groups = (end - x) / 4;
+	if (groups) {
+		kernel(row + x / 4 * 5, dst, groups);
+		dst += groups * 4;
+		x += groups * 4;
+	}
+
+	while (x < end) {
+		*dst++ = pixel(row + x / 4 * 5, x % 4);
+		x++;
+	}
+}
+
+} /* namespace */
+
+} /* namespace ov7251 */
+
+using namespace ov7251;
+
+extern "C" {
+
+int ov7251_unpack_isa_supported(enum ov7251_unpack_isa isa)
+{
+	return isa == OV7251_UNPACK_ISA_AUTO || kernelsFor(isa) != nullptr;
+}
+
+int ov7251_unpack_set_isa(enum ov7251_unpack_isa isa)
+{
+	if (!ov7251_unpack_isa_supported(isa))
+		return -ENOTSUP;
+
+	current_isa.store(isa, std::memory_order_relaxed);
+	return 0;
+}
+
+enum ov7251_unpack_isa ov7251_unpack_get_isa(void)
+{
+	return activeIsa();
+}
+
+const char *ov7251_unpack_isa_name(enum ov7251_unpack_isa isa)
+{
+	switch (isa) {
+	case OV7251_UNPACK_ISA_AUTO:
+		return "auto";
+	case OV7251_UNPACK_ISA_SCALAR:
+		return "scalar";
+	case OV7251_UNPACK_ISA_SSSE3:
+		return "ssse3";
+	case OV7251_UNPACK_ISA_AVX2:
+		return "avx2";
+	case OV7251_UNPACK_ISA_NEON:
+		return "neon";
+	}
+	return "unknown";
+}
+
+int ov7251_y10p_to_y16(const uint8_t *src, size_t src_stride,
+		       unsigned int width, unsigned int height,
+		       uint16_t *dst, size_t dst_stride,
+		       const struct ov7251_unpack_roi *roi, unsigned int flags)
+{
+	const UnpackKernels *k = kernelsFor(activeIsa());
+	struct ov7251_unpack_roi r;
+	unsigned int lshift = flags & OV7251_UNPACK_MSB_ALIGN ? 6 : 0;
+	int ret;
+
+	ret = checkArgs(src, src_stride, width, height, dst, roi, r);
+	if (ret)
+		return ret;
+	if (dst_stride < r.width * sizeof(uint16_t))
+		return -EINVAL;
+
+	auto kernel = [k, lshift](const uint8_t *s, uint16_t *d, unsigned int g) {
+		k->y16(s, d, g, lshift);
+	};
+	auto pixel = [lshift](const uint8_t *group, unsigned int i) {
+		return static_cast<uint16_t>(y10pPixel(group, i) << lshift);
+	};
+
+	for (unsigned int y = 0; y < r.height; y++) {
+		const uint8_t *row = src + (r.y + y) * src_stride;
+		uint16_t *out = reinterpret_cast<uint16_t *>(
+			reinterpret_cast<uint8_t *>(dst) + y * dst_stride);
+
+		convertRow(row, out, r.x, r.width, kernel, pixel);
+	}
+
+	return 0;
+}
+
+int ov7251_y10p_to_y8(const uint8_t *src, size_t src_stride,
+		      unsigned int width, unsigned int height,
+		      uint8_t *dst, size_t dst_stride,
+		      const struct ov7251_unpack_roi *roi, unsigned int shift)
+{
+	const UnpackKernels *k = kernelsFor(activeIsa());
+	struct ov7251_unpack_roi r;
+	int ret;
+
+	if (shift > 2)
+		return -EINVAL;
+
+	ret = checkArgs(src, src_stride, width, height, dst, roi, r);
+	if (ret)
+		return ret;
+	if (dst_stride < r.width)
+		return -EINVAL;
+
+	auto kernel = [k, shift](const uint8_t *s, uint8_t *d, unsigned int g) {
+		k->y8(s, d, g, shift);
+	};
+	auto pixel = [shift](const uint8_t *group, unsigned int i) {
+		return saturate8(y10pPixel(group, i) >> shift);
+	};
+
+	for (unsigned int y = 0; y < r.height; y++)
+		convertRow(src + (r.y + y) * src_stride, dst + y * dst_stride,
+			   r.x, r.width, kernel, pixel);
+
+	return 0;
+}
+
+int ov7251_y10p_to_y8_lut(const uint8_t *src, size_t src_stride,
+			  unsigned int width, unsigned int height,
+			  uint8_t *dst, size_t dst_stride,
+			  const struct ov7251_unpack_roi *roi,
+			  const uint8_t lut[1024])
+{
+	const UnpackKernels *k = kernelsFor(activeIsa());
+	struct ov7251_unpack_roi r;
+	int ret;
+
+	if (!lut)
+		return -EINVAL;
+
+	ret = checkArgs(src, src_stride, width, height, dst, roi, r);
+	if (ret)
+		return ret;
+	if (dst_stride < r.width)
+		return -EINVAL;
+
+	/*
+	 * Table lookups do not vectorise well, so unpack a block of pixels
+	 * with the SIMD kernel into a small stack buffer and map that.
+	 */
+	constexpr unsigned int block_groups = 64;
+	uint16_t tmp[block_groups * 4];
+
+	auto kernel = [k, lut, &tmp](const uint8_t *s, uint8_t *d, unsigned int g) {
+		while (g) {
+			unsigned int n = g < block_groups ? g : block_groups;
+
+			k->y16(s, tmp, n, 0);
+			for (unsigned int i = 0; i < n * 4; i++)
+				d[i] = lut[tmp[i]];
+			s += n * 5;
+			d += n * 4;
+			g -= n;
+		}
+	};
+	auto pixel = [lut](const uint8_t *group, unsigned int i) {
+		return lut[y10pPixel(group, i)];
+	};
+
+	for (unsigned int y = 0; y < r.height; y++)
+		convertRow(src + (r.y + y) * src_stride, dst + y * dst_stride,
+			   r.x, r.width, kernel, pixel);
+
+	return 0;
+}
+
+} /* extern "C" */
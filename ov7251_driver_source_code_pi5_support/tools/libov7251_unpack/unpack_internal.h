@@ -0,0 +1,50 @@
+/*
+ * libov7251_unpack - internal kernel interface
+ *
+ * Copyright (C) 2022 SHENZHEN InnoMaker
+ *
+ * Row kernels start at a 5-byte group boundary and convert "groups" groups
+ * of 4 pixels. They never read past src + groups * 5.
+ */
+
+#ifndef OV7251_UNPACK_INTERNAL_H
+#define OV7251_UNPACK_INTERNAL_H
+
+#include <cstdint>
+
+namespace ov7251 {
+
+using RowY16Fn = void (*)(const uint8_t *src, uint16_t *dst,
+			  unsigned int groups, unsigned int lshift);
+using RowY8Fn = void (*)(const uint8_t *src, uint8_t *dst,
+			 unsigned int groups, unsigned int rshift);
+
+struct UnpackKernels {
+	RowY16Fn y16;
+	RowY8Fn y8;
+};
+
+inline uint16_t y10pPixel(const uint8_t *group, unsigned int i)
+{
+	return static_cast<uint16_t>((group[i] << 2) |
+				     ((group[4] >> (2 * i)) & 3));
+}
+
+inline uint8_t saturate8(unsigned int v)
+{
+	return v > 255 ? 255 : static_cast<uint8_t>(v);
+}
+
+void scalarRowY16(const uint8_t *src, uint16_t *dst, unsigned int groups,
+		  unsigned int lshift);
+void scalarRowY8(const uint8_t *src, uint8_t *dst, unsigned int groups,
+		 unsigned int rshift);
+
+/* Return nullptr when the kernels are not built for this target. */
+const UnpackKernels *ssse3Kernels();
+const UnpackKernels *avx2Kernels();
+const UnpackKernels *neonKernels();
+
+} /* namespace ov7251 */
+
+#endif /* OV7251_UNPACK_INTERNAL_H */
@@ -0,0 +1,86 @@
+/*
+ * libov7251_unpack - NEON kernels (AArch64, e.g. the Cortex-A76 on Pi 5)
+ *
+ * Copyright (C) 2022 SHENZHEN InnoMaker
+ *
+ * Same layout as the x86 kernels: TBL gathers the high bytes and the
+ * shared low-bits byte into 16-bit lanes, and a per-lane variable shift
+ * extracts each pixel's two low bits.
+ */
+
+#include "unpack_internal.h"
+
+#if defined(__aarch64__)
+
+#include <arm_neon.h>
+
+namespace ov7251 {
+
+namespace {
+
+inline uint16x8_t unpack8Neon(const uint8_t *src)
+{
+	/* Out-of-range TBL indices (0xff) read as zero */
+	static const uint8_t msb_idx[16] = { 0, 0xff, 1, 0xff, 2, 0xff, 3, 0xff,
+					     5, 0xff, 6, 0xff, 7, 0xff, 8, 0xff };
+	static const uint8_t lsb_idx[16] = { 4, 0xff, 4, 0xff, 4, 0xff, 4, 0xff,
+					     9, 0xff, 9, 0xff, 9, 0xff, 9, 0xff };
+	static const int16_t lsb_shift[8] = { 0, -2, -4, -6, 0, -2, -4, -6 };
+	uint8x16_t in = vld1q_u8(src);
+	uint16x8_t msb = vreinterpretq_u16_u8(vqtbl1q_u8(in, vld1q_u8(msb_idx)));
+	uint16x8_t lsb = vreinterpretq_u16_u8(vqtbl1q_u8(in, vld1q_u8(lsb_idx)));
+	uint16x8_t low = vandq_u16(vshlq_u16(lsb, vld1q_s16(lsb_shift)),
+				   vdupq_n_u16(3));
+
+	return vorrq_u16(vshlq_n_u16(msb, 2), low);
+}
+
+/* A 16-byte load at group g needs g + 4 groups in the row. */
+void neonRowY16(const uint8_t *src, uint16_t *dst, unsigned int groups,
+		unsigned int lshift)
+{
+	const int16x8_t shift = vdupq_n_s16(static_cast<int16_t>(lshift));
+
+	for (; groups >= 4; groups -= 2, src += 10, dst += 8)
+		vst1q_u16(dst, vshlq_u16(unpack8Neon(src), shift));
+
+	scalarRowY16(src, dst, groups, lshift);
+}
+
+void neonRowY8(const uint8_t *src, uint8_t *dst, unsigned int groups,
+	       unsigned int rshift)
+{
+	const int16x8_t shift = vdupq_n_s16(-static_cast<int16_t>(rshift));
+
+	for (; groups >= 6; groups -= 4, src += 20, dst += 16) {
+		uint8x8_t a = vqmovn_u16(vshlq_u16(unpack8Neon(src), shift));
+		uint8x8_t b = vqmovn_u16(vshlq_u16(unpack8Neon(src + 10), shift));
+
+		vst1q_u8(dst, vcombine_u8(a, b));
+	}
+	scalarRowY8(src, dst, groups, rshift);
+}
+
+const UnpackKernels neon_kernels = { neonRowY16, neonRowY8 };
+
+} /* namespace */
+
+const UnpackKernels *neonKernels()
+{
+	return &neon_kernels;
+}
+
+} /* namespace ov7251 */
+
+#else /* !__aarch64__ */
+
+namespace ov7251 {
+
+const UnpackKernels *neonKernels()
+{
+	return nullptr;
+}
+
+} /* namespace ov7251 */
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * libov7251_unpack - SSSE3 and AVX2 kernels
+ *
+ * Copyright (C) 2022 SHENZHEN InnoMaker
+ *
+ * Built with per-function target attributes so the library needs no
+ * special compiler flags; the kernels are only handed out after a CPUID
+ * check. Each 128-bit lane works on two 5-byte groups (8 pixels):
+ *
+ *   msb  = pshufb(in, {0,1,2,3,5,6,7,8} -> 16-bit lanes)
+ *   lsb  = pshufb(in, {4,4,4,4,9,9,9,9} -> 16-bit lanes)
+ *   low2 = ((lsb * {64,16,4,1,...}) >> 6) & 3
+ *   pix  = msb << 2 | low2
+ */
+
+#include "unpack_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+namespace ov7251 {
+
+namespace {
+
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+SSSE3_TARGET inline __m128i unpack8Ssse3(const uint8_t *src)
+{
+	const __m128i msb_idx = _mm_setr_epi8(0, -1, 1, -1, 2, -1, 3, -1,
+					      5, -1, 6, -1, 7, -1, 8, -1);
+	const __m128i lsb_idx = _mm_setr_epi8(4, -1, 4, -1, 4, -1, 4, -1,
+					      9, -1, 9, -1, 9, -1, 9, -1);
+	const __m128i mult = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1);
+	const __m128i three = _mm_set1_epi16(3);
+	__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+	__m128i msb = _mm_shuffle_epi8(in, msb_idx);
+	__m128i lsb = _mm_shuffle_epi8(in, lsb_idx);
+	__m128i low = _mm_and_si128(_mm_srli_epi16(_mm_mullo_epi16(lsb, mult), 6),
+				    three);
+
+	return _mm_or_si128(_mm_slli_epi16(msb, 2), low);
+}
+
+/* A 16-byte load at group g needs g + 4 groups in the row. */
+SSSE3_TARGET void ssse3RowY16(const uint8_t *src, uint16_t *dst,
+			      unsigned int groups, unsigned int lshift)
+{
+	const __m128i shift = _mm_cvtsi32_si128(lshift);
+
+	for (; groups >= 4; groups -= 2, src += 10, dst += 8) {
+		__m128i v = _mm_sll_epi16(unpack8Ssse3(src), shift);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), v);
+	}
+	scalarRowY16(src, dst, groups, lshift);
+}
+
+SSSE3_TARGET void ssse3RowY8(const uint8_t *src, uint8_t *dst,
+			     unsigned int groups, unsigned int rshift)
+{
+	const __m128i shift = _mm_cvtsi32_si128(rshift);
+
+	for (; groups >= 6; groups -= 4, src += 20, dst += 16) {
+		__m128i a = _mm_srl_epi16(unpack8Ssse3(src), shift);
+		__m128i b = _mm_srl_epi16(unpack8Ssse3(src + 10), shift);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+				 _mm_packus_epi16(a, b));
+	}
+	scalarRowY8(src, dst, groups, rshift);
+}
+
+/* Lane 0 takes the groups at src, lane 1 the groups at src + 10. */
+AVX2_TARGET inline __m256i unpack16Avx2(const uint8_t *src)
+{
+	const __m256i msb_idx = _mm256_setr_epi8(
+		0, -1, 1, -1, 2, -1, 3, -1, 5, -1, 6, -1, 7, -1, 8, -1,
+		0, -1, 1, -1, 2, -1, 3, -1, 5, -1, 6, -1, 7, -1, 8, -1);
+	const __m256i lsb_idx = _mm256_setr_epi8(
+		4, -1, 4, -1, 4, -1, 4, -1, 9, -1, 9, -1, 9, -1, 9, -1,
+		4, -1, 4, -1, 4, -1, 4, -1, 9, -1, 9, -1, 9, -1, 9, -1);
+	const __m256i mult = _mm256_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1,
+					       64, 16, 4, 1, 64, 16, 4, 1);
+	const __m256i three = _mm256_set1_epi16(3);
+	__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+	__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 10));
+	__m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+	__m256i msb = _mm256_shuffle_epi8(in, msb_idx);
+	__m256i lsb = _mm256_shuffle_epi8(in, lsb_idx);
+	__m256i low = _mm256_and_si256(
+		_mm256_srli_epi16(_mm256_mullo_epi16(lsb, mult), 6), three);
+
+	return _mm256_or_si256(_mm256_slli_epi16(msb, 2), low);
+}
+
+/* Loads reach src + 26, so keep 6 groups in hand. */
+AVX2_TARGET void avx2RowY16(const uint8_t *src, uint16_t *dst,
+			    unsigned int groups, unsigned int lshift)
+{
+	const __m128i shift = _mm_cvtsi32_si128(lshift);
+
+	for (; groups >= 6; groups -= 4, src += 20, dst += 16) {
+		__m256i v = _mm256_sll_epi16(unpack16Avx2(src), shift);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), v);
+	}
+	ssse3RowY16(src, dst, groups, lshift);
+}
+
+/* Loads reach src + 46, so keep 10 groups in hand. */
+AVX2_TARGET void avx2RowY8(const uint8_t *src, uint8_t *dst,
+			   unsigned int groups, unsigned int rshift)
+{
+	const __m128i shift = _mm_cvtsi32_si128(rshift);
+
+	for (; groups >= 10; groups -= 8, src += 40, dst += 32) {
+		__m256i a = _mm256_srl_epi16(unpack16Avx2(src), shift);
+		__m256i b = _mm256_srl_epi16(unpack16Avx2(src + 20), shift);
+		/* packus works per lane: a0 b0 a1 b1 -> a0 a1 b0 b1 */
+		__m256i v = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b),
+						     0xd8);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), v);
+	}
+	ssse3RowY8(src, dst, groups, rshift);
+}
+
+const UnpackKernels ssse3_kernels = { ssse3RowY16, ssse3RowY8 };
+const UnpackKernels avx2_kernels = { avx2RowY16, avx2RowY8 };
+
+} /* namespace */
+
+const UnpackKernels *ssse3Kernels()
+{
+	return __builtin_cpu_supports("ssse3") ? &ssse3_kernels : nullptr;
+}
+
+const UnpackKernels *avx2Kernels()
+{
+	return __builtin_cpu_supports("avx2") ? &avx2_kernels : nullptr;
+}
+
+} /* namespace ov7251 */
+
+#else /* !x86 */
+
+namespace ov7251 {
+
+const UnpackKernels *ssse3Kernels()
+{
+	return nullptr;
+}
+
+const UnpackKernels *avx2Kernels()
+{
+	return nullptr;
+}
+
+} /* namespace ov7251 */
+
+#endif
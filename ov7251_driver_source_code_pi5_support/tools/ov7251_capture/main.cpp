@@ -0,0 +1,285 @@
+/*
+ * ov7251_capture - frame rate, jitter and latency benchmark for the
+ * InnoMaker MIPI OV7251 capture pipeline
+ *
+ * Copyright (C) 2022 SHENZHEN InnoMaker
+ *
+ * Streams from a V4L2 capture node with MMAP buffers exported as DMABUF
+ * (frames are never copied) and reports delivered fps, frame interval
+ * jitter, sequence gaps and capture-to-userspace latency taken from the
+ * buffer timestamps. Works against any capture driver, e.g. vivid:
+ *
+ *   sudo modprobe vivid && ov7251_capture -d /dev/video0 -n 300
+ */
+
+#include <cerrno>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+
+#include <getopt.h>
+
+#include "../common/stats.h"
+#include "../common/v4l2_capture.h"
+
+using namespace ov7251;
+
+namespace {
+
+volatile sig_atomic_t stop_requested;
+
+void onSignal(int)
+{
+	stop_requested = 1;
+}
+
+struct Options {
+	std::string device = "/dev/video0";
+	std::string subdev;
+	unsigned int frames = 600;
+	unsigned int buffers = 4;
+	unsigned int warmup = 0;
+	unsigned int width = 0;
+	unsigned int height = 0;
+	uint32_t pixelformat = 0;
+	int timeout_ms = 2000;
+	bool verbose = false;
+};
+
+void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -d, --device PATH    capture node (default /dev/video0)\n"
+		"  -s, --subdev PATH    ov7251 subdev, reads the sensor frame counter\n"
+		"  -n, --frames N       frames to capture (default 600)\n"
+		"  -b, --buffers N      buffers to queue (default 4)\n"
+		"  -w, --warmup N       frames excluded from statistics (default 0)\n"
+		"  -W, --width N        set capture width\n"
+		"  -H, --height N       set capture height\n"
+		"  -f, --format FOURCC  set pixel format, e.g. Y10P or GREY\n"
+		"  -t, --timeout MS     dequeue timeout (default 2000)\n"
+		"  -v, --verbose        print one line per frame\n",
+		argv0);
+}
+
+bool parseOptions(int argc, char **argv, Options &opts)
+{
+	static const struct option long_opts[] = {
+		{ "device", required_argument, nullptr, 'd' },
+		{ "subdev", required_argument, nullptr, 's' },
+		{ "frames", required_argument, nullptr, 'n' },
+		{ "buffers", required_argument, nullptr, 'b' },
+		{ "warmup", required_argument, nullptr, 'w' },
+		{ "width", required_argument, nullptr, 'W' },
+		{ "height", required_argument, nullptr, 'H' },
+		{ "format", required_argument, nullptr, 'f' },
+		{ "timeout", required_argument, nullptr, 't' },
+		{ "verbose", no_argument, nullptr, 'v' },
+		{ "help", no_argument, nullptr, 'h' },
+		{ nullptr, 0, nullptr, 0 },
+	};
+	int c;
+
+	while ((c = getopt_long(argc, argv, "d:s:n:b:w:W:H:f:t:vh",
+				long_opts, nullptr)) != -1) {
+		switch (c) {
+		case 'd':
+			opts.device = optarg;
+			break;
+		case 's':
+			opts.subdev = optarg;
+			break;
+		case 'n':
+			opts.frames = strtoul(optarg, nullptr, 0);
+			break;
+		case 'b':
+			opts.buffers = strtoul(optarg, nullptr, 0);
+			break;
+		case 'w':
+			opts.warmup = strtoul(optarg, nullptr, 0);
+			break;
+		case 'W':
+			opts.width = strtoul(optarg, nullptr, 0);
+			break;
+		case 'H':
+			opts.height = strtoul(optarg, nullptr, 0);
+			break;
+		case 'f':
+			opts.pixelformat = stringToFourcc(optarg);
+			break;
+		case 't':
+			opts.timeout_ms = strtol(optarg, nullptr, 0);
+			break;
+		case 'v':
+			opts.verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+			return false;
+		}
+	}
+
+	if (!opts.frames || !opts.buffers) {
+		usage(argv[0]);
+		return false;
+	}
+
+	return true;
+}
+
+void printPercentiles(const char *name, Samples &s)
+{
+	printf("%-14s min %8.3f  p50 %8.3f  p90 %8.3f  p99 %8.3f  p99.9 %8.3f  max %8.3f  (ms)\n",
+	       name, s.min(), s.percentile(50), s.percentile(90),
+	       s.percentile(99), s.percentile(99.9), s.max());
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+	Options opts;
+	V4l2Capture capture;
+	V4l2Subdev subdev;
+	Samples intervals, latencies;
+	int64_t sensor_before = 0, sensor_after = 0;
+	bool have_sensor_count = false;
+	bool monotonic = true;
+	uint64_t dropped = 0;
+	unsigned int captured = 0, counted = 0;
+	int64_t first_ts = 0, last_ts = 0;
+	uint32_t first_seq = 0, last_seq = 0;
+
+	if (!parseOptions(argc, argv, opts))
+		return EXIT_FAILURE;
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+
+	intervals.reserve(opts.frames);
+	latencies.reserve(opts.frames);
+
+	try {
+		capture.open(opts.device);
+
+		Format fmt = capture.format();
+		if (opts.width || opts.height || opts.pixelformat)
+			fmt = capture.setFormat(opts.width, opts.height,
+						opts.pixelformat);
+		printf("%s: %ux%u %s stride %u size %u\n", opts.device.c_str(),
+		       fmt.width, fmt.height,
+		       fourccToString(fmt.pixelformat).c_str(),
+		       fmt.bytesperline, fmt.sizeimage);
+
+		if (!opts.subdev.empty())
+			subdev.open(opts.subdev);
+
+		capture.allocate(opts.buffers);
+		printf("%u buffers, dmabuf export %s\n", capture.bufferCount(),
+		       capture.dmabufExported() ? "enabled" : "unavailable");
+
+		capture.start();
+
+		while (captured < opts.frames && !stop_requested) {
+			Frame frame;
+
+			if (!capture.dequeue(frame, opts.timeout_ms)) {
+				if (stop_requested)
+					break;
+				fprintf(stderr, "timeout after %u frames\n",
+					captured);
+				break;
+			}
+
+			/* The counter only exists while the sensor streams */
+			if (captured == opts.warmup && subdev.isOpen())
+				have_sensor_count = subdev.getControl(kCidFrameCount,
+								      sensor_before);
+
+			if (captured >= opts.warmup) {
+				if (counted) {
+					double interval = (frame.timestamp_ns - last_ts) / 1e6;
+
+					intervals.add(interval);
+					if (frame.sequence != last_seq + 1)
+						dropped += frame.sequence - last_seq - 1;
+				} else {
+					first_ts = frame.timestamp_ns;
+					first_seq = frame.sequence;
+				}
+				/* Latency is meaningless against another clock */
+				if (!frame.monotonic && monotonic) {
+					fprintf(stderr, "warning: buffer timestamps are not CLOCK_MONOTONIC, latency not reported\n");
+					monotonic = false;
+				}
+				if (monotonic)
+					latencies.add((frame.dequeue_ns - frame.timestamp_ns) / 1e6);
+				last_ts = frame.timestamp_ns;
+				last_seq = frame.sequence;
+				counted++;
+			}
+
+			if (opts.verbose && frame.monotonic)
+				printf("seq %6u  ts %" PRId64 ".%06" PRId64 "  bytes %u  latency %.3f ms  dmabuf %d\n",
+				       frame.sequence,
+				       static_cast<int64_t>(frame.timestamp_ns / 1000000000),
+				       static_cast<int64_t>(frame.timestamp_ns % 1000000000 / 1000),
+				       frame.bytesused,
+				       (frame.dequeue_ns - frame.timestamp_ns) / 1e6,
+				       frame.dmabuf_fd);
+			else if (opts.verbose)
+				printf("seq %6u  ts %" PRId64 ".%06" PRId64 "  bytes %u  dmabuf %d\n",
+				       frame.sequence,
+				       static_cast<int64_t>(frame.timestamp_ns / 1000000000),
+				       static_cast<int64_t>(frame.timestamp_ns % 1000000000 / 1000),
+				       frame.bytesused, frame.dmabuf_fd);
+
+			capture.requeue(frame);
+			captured++;
+		}
+
+		if (have_sensor_count)
+			have_sensor_count = subdev.getControl(kCidFrameCount,
+							      sensor_after);
+
+		capture.stop();
+	} catch (const std::system_error &e) {
+		fprintf(stderr, "error: %s\n", e.what());
+		return EXIT_FAILURE;
+	}
+
+	if (counted < 2) {
+		fprintf(stderr, "not enough frames for statistics\n");
+		return EXIT_FAILURE;
+	}
+
+	double span_s = (last_ts - first_ts) / 1e9;
+
+	printf("\nframes %u (warmup %u), sequence %u..%u\n", counted,
+	       opts.warmup, first_seq, last_seq);
+	printf("fps            %.3f\n", span_s > 0 ? (counted - 1) / span_s : 0.0);
+	printf("dropped        %" PRIu64 " (sequence gaps)\n", dropped);
+	printPercentiles("interval", intervals);
+	printf("%-14s stddev %.3f ms, p99-p50 %.3f ms\n", "jitter",
+	       intervals.stddev(),
+	       intervals.percentile(99) - intervals.percentile(50));
+	if (monotonic)
+		printPercentiles("latency", latencies);
+	else
+		printf("%-14s n/a (timestamps not CLOCK_MONOTONIC)\n", "latency");
+
+	if (have_sensor_count) {
+		int64_t sensor = sensor_after - sensor_before;
+		int64_t delivered = static_cast<int64_t>(last_seq - first_seq);
+
+		printf("sensor frames  %" PRId64 ", delivered %" PRId64
+		       ", lost in receiver %" PRId64 "\n",
+		       sensor, delivered, sensor - delivered);
+	}
+
+	return EXIT_SUCCESS;
+}
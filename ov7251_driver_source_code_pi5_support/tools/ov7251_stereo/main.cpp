@@ -0,0 +1,253 @@
+/*
+ * ov7251_stereo - pair frames from two triggered InnoMaker MIPI OV7251
+ * cameras and report pairing statistics
+ *
+ * Copyright (C) 2022 SHENZHEN InnoMaker
+ *
+ * Intended for the dual-camera overlay with both sensors in an external
+ * trigger mode (sensor_mode 2/3). Can be tried without cameras on two
+ * vivid instances, whose free-running timestamps need a wide tolerance:
+ *
+ *   sudo modprobe vivid n_devs=2 && ov7251_stereo -l /dev/video0 -r /dev/video1 -t 20000
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+
+#include <getopt.h>
+
+#include "../common/stats.h"
+#include "stereo_sync.h"
+
+using namespace ov7251;
+
+namespace {
+
+volatile sig_atomic_t stop_requested;
+
+void onSignal(int)
+{
+	stop_requested = 1;
+}
+
+struct Options {
+	std::string left = "/dev/video0";
+	std::string right = "/dev/video8";
+	unsigned int pairs = 600;
+	unsigned int buffers = 6;
+	unsigned int width = 0;
+	unsigned int height = 0;
+	uint32_t pixelformat = 0;
+	int64_t tolerance_us = 1000;
+	int timeout_ms = 2000;
+	StereoSync::Match match = StereoSync::Match::Timestamp;
+	bool verbose = false;
+};
+
+void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -l, --left PATH       left capture node (default /dev/video0)\n"
+		"  -r, --right PATH      right capture node (default /dev/video8)\n"
+		"  -n, --pairs N         pairs to collect (default 600)\n"
+		"  -b, --buffers N       buffers per camera (default 6)\n"
+		"  -t, --tolerance US    max timestamp skew of a pair (default 1000)\n"
+		"  -S, --sequence        match by sequence number instead of timestamp\n"
+		"  -W, --width N         set capture width on both\n"
+		"  -H, --height N        set capture height on both\n"
+		"  -f, --format FOURCC   set pixel format on both\n"
+		"  -T, --timeout MS      wait for a pair at most MS (default 2000)\n"
+		"  -v, --verbose         print one line per pair\n",
+		argv0);
+}
+
+bool parseOptions(int argc, char **argv, Options &opts)
+{
+	static const struct option long_opts[] = {
+		{ "left", required_argument, nullptr, 'l' },
+		{ "right", required_argument, nullptr, 'r' },
+		{ "pairs", required_argument, nullptr, 'n' },
+		{ "buffers", required_argument, nullptr, 'b' },
+		{ "tolerance", required_argument, nullptr, 't' },
+		{ "sequence", no_argument, nullptr, 'S' },
+		{ "width", required_argument, nullptr, 'W' },
+		{ "height", required_argument, nullptr, 'H' },
+		{ "format", required_argument, nullptr, 'f' },
+		{ "timeout", required_argument, nullptr, 'T' },
+		{ "verbose", no_argument, nullptr, 'v' },
+		{ "help", no_argument, nullptr, 'h' },
+		{ nullptr, 0, nullptr, 0 },
+	};
+	int c;
+
+	while ((c = getopt_long(argc, argv, "l:r:n:b:t:SW:H:f:T:vh",
+				long_opts, nullptr)) != -1) {
+		switch (c) {
+		case 'l':
+			opts.left = optarg;
+			break;
+		case 'r':
+			opts.right = optarg;
+			break;
+		case 'n':
+			opts.pairs = strtoul(optarg, nullptr, 0);
+			break;
+		case 'b':
+			opts.buffers = strtoul(optarg, nullptr, 0);
+			break;
+		case 't':
+			opts.tolerance_us = strtoll(optarg, nullptr, 0);
+			break;
+		case 'S':
+			opts.match = StereoSync::Match::Sequence;
+			break;
+		case 'W':
+			opts.width = strtoul(optarg, nullptr, 0);
+			break;
+		case 'H':
+			opts.height = strtoul(optarg, nullptr, 0);
+			break;
+		case 'f':
+			opts.pixelformat = stringToFourcc(optarg);
+			break;
+		case 'T':
+			opts.timeout_ms = strtol(optarg, nullptr, 0);
+			break;
+		case 'v':
+			opts.verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+			return false;
+		}
+	}
+
+	if (!opts.pairs || opts.buffers < 2) {
+		usage(argv[0]);
+		return false;
+	}
+
+	return true;
+}
+
+void printPercentiles(const char *name, Samples &s)
+{
+	printf("%-16s min %8.3f  p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f  (ms)\n",
+	       name, s.min(), s.percentile(50), s.percentile(90),
+	       s.percentile(99), s.max());
+}
+
+} /* namespace */
+
+int main(int argc, char **argv)
+{
+	Options opts;
+	Samples skew, pairing, end_to_end;
+	StereoStats st;
+	int64_t first_ns = 0, last_ns = 0;
+	unsigned int collected = 0;
+	bool monotonic = true;
+
+	if (!parseOptions(argc, argv, opts))
+		return EXIT_FAILURE;
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+
+	try {
+		StereoSync sync(opts.left, opts.right, opts.buffers, opts.match,
+				opts.tolerance_us * 1000);
+
+		if (opts.width || opts.height || opts.pixelformat) {
+			sync.leftCapture().setFormat(opts.width, opts.height,
+						     opts.pixelformat);
+			sync.rightCapture().setFormat(opts.width, opts.height,
+						      opts.pixelformat);
+		}
+
+		for (V4l2Capture *cap : { &sync.leftCapture(), &sync.rightCapture() }) {
+			Format fmt = cap->format();
+
+			printf("%s: %ux%u %s\n", cap->path().c_str(), fmt.width,
+			       fmt.height, fourccToString(fmt.pixelformat).c_str());
+		}
+
+		sync.start();
+
+		while (collected < opts.pairs && !stop_requested) {
+			StereoPair pair;
+
+			if (!sync.next(pair, opts.timeout_ms)) {
+				if (!stop_requested)
+					fprintf(stderr, "timeout after %u pairs\n",
+						collected);
+				break;
+			}
+
+			int64_t newest = std::max(pair.left.dequeue_ns,
+						  pair.right.dequeue_ns);
+			int64_t oldest = std::min(pair.left.timestamp_ns,
+						  pair.right.timestamp_ns);
+
+			skew.add(std::abs(pair.skew_ns) / 1e6);
+			pairing.add((pair.paired_ns - newest) / 1e6);
+			/* Only comparable with paired_ns on the same clock */
+			if ((!pair.left.monotonic || !pair.right.monotonic) &&
+			    monotonic) {
+				fprintf(stderr, "warning: buffer timestamps are not CLOCK_MONOTONIC, end-to-end latency not reported\n");
+				monotonic = false;
+			}
+			if (monotonic)
+				end_to_end.add((pair.paired_ns - oldest) / 1e6);
+
+			if (!collected)
+				first_ns = pair.paired_ns;
+			last_ns = pair.paired_ns;
+
+			if (opts.verbose)
+				printf("pair %6u  seq %6u/%-6u  skew %8.3f ms  dmabuf %d/%d\n",
+				       collected, pair.left.sequence,
+				       pair.right.sequence, pair.skew_ns / 1e6,
+				       pair.left.dmabuf_fd, pair.right.dmabuf_fd);
+
+			/* A real consumer would hand the DMABUFs on before this */
+			sync.release(pair);
+			collected++;
+		}
+
+		st = sync.stats();
+		sync.stop();
+	} catch (const std::system_error &e) {
+		fprintf(stderr, "error: %s\n", e.what());
+		return EXIT_FAILURE;
+	}
+
+	if (collected < 2) {
+		fprintf(stderr, "not enough pairs for statistics\n");
+		return EXIT_FAILURE;
+	}
+
+	double span_s = (last_ns - first_ns) / 1e9;
+
+	printf("\npairs            %" PRIu64 " (%.3f pairs/s)\n", st.pairs,
+	       span_s > 0 ? (collected - 1) / span_s : 0.0);
+	printf("unmatched        left %" PRIu64 ", right %" PRIu64 "\n",
+	       st.unmatched_left, st.unmatched_right);
+	printf("queue overflow   left %" PRIu64 ", right %" PRIu64 "\n",
+	       st.overflow_left, st.overflow_right);
+	printPercentiles("skew", skew);
+	printPercentiles("pairing latency", pairing);
+	if (monotonic)
+		printPercentiles("end-to-end", end_to_end);
+	else
+		printf("%-16s n/a (timestamps not CLOCK_MONOTONIC)\n", "end-to-end");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,278 @@
+/*
+ * Stereo frame pairing for two triggered InnoMaker MIPI OV7251 cameras
+ *
+ * Copyright (C) 2022 SHENZHEN InnoMaker
+ */
+
+#include "stereo_sync.h"
+
+#include <cerrno>
+#include <system_error>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace ov7251 {
+
+namespace {
+
+void signalFd(int fd)
+{
+	uint64_t one = 1;
+
+	if (write(fd, &one, sizeof(one)) < 0) {
+		/* Counter saturated, the reader is awake anyway */
+	}
+}
+
+void drainFd(int fd)
+{
+	uint64_t count;
+
+	if (read(fd, &count, sizeof(count)) < 0) {
+		/* EAGAIN, already drained */
+	}
+}
+
+int makeEventFd()
+{
+	int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+	if (fd < 0)
+		throw std::system_error(errno, std::generic_category(), "eventfd");
+	return fd;
+}
+
+} /* namespace */
+
+StereoSync::StereoSync(const std::string &left, const std::string &right,
+		       unsigned int buffers, Match match, int64_t tolerance_ns)
+	: match_(match), tolerance_ns_(tolerance_ns), buffers_(buffers)
+{
+	event_fd_ = makeEventFd();
+	for (Camera &cam : cams_)
+		cam.wake_fd = makeEventFd();
+
+	cams_[0].capture.open(left);
+	cams_[1].capture.open(right);
+}
+
+StereoSync::~StereoSync()
+{
+	stop();
+	for (Camera &cam : cams_) {
+		if (cam.wake_fd >= 0)
+			close(cam.wake_fd);
+	}
+	if (event_fd_ >= 0)
+		close(event_fd_);
+}
+
+void StereoSync::start()
+{
+	for (Camera &cam : cams_) {
+		cam.capture.allocate(buffers_);
+		/* Room for every buffer, so the return path never fills up */
+		cam.ready = std::make_unique<SpscQueue<Frame>>(cam.capture.bufferCount());
+		cam.done = std::make_unique<SpscQueue<Frame>>(cam.capture.bufferCount());
+		cam.have_first = false;
+		cam.unmatched = 0;
+		cam.overflow = 0;
+	}
+	pairs_ = 0;
+	error_ = 0;
+
+	for (Camera &cam : cams_)
+		cam.capture.start();
+
+	running_ = true;
+	for (Camera &cam : cams_)
+		cam.thread = std::thread(&StereoSync::captureLoop, this, std::ref(cam));
+}
+
+void StereoSync::stop()
+{
+	running_ = false;
+
+	for (Camera &cam : cams_) {
+		if (cam.wake_fd >= 0)
+			signalFd(cam.wake_fd);
+	}
+	for (Camera &cam : cams_) {
+		if (cam.thread.joinable())
+			cam.thread.join();
+	}
+
+	/* STREAMOFF returns every buffer, queued or not */
+	for (Camera &cam : cams_) {
+		try {
+			if (cam.ready)
+				cam.capture.stop();
+		} catch (const std::system_error &) {
+		}
+		cam.ready.reset();
+		cam.done.reset();
+	}
+}
+
+void StereoSync::captureLoop(Camera &cam)
+{
+	struct pollfd pfds[2] = {
+		{ cam.capture.fd(), POLLIN, 0 },
+		{ cam.wake_fd, POLLIN, 0 },
+	};
+
+	try {
+		while (running_) {
+			Frame frame;
+
+			while (Frame *f = cam.done->front()) {
+				cam.capture.requeue(*f);
+				cam.done->pop();
+			}
+
+			/* Sleeps until a frame is ready or buffers come back */
+			if (poll(pfds, 2, -1) < 0) {
+				if (errno == EINTR)
+					continue;
+				throw std::system_error(errno, std::generic_category(),
+							"poll");
+			}
+			if (pfds[1].revents & POLLIN)
+				drainFd(cam.wake_fd);
+			if (!pfds[0].revents || !cam.capture.dequeue(frame, 0))
+				continue;
+
+			if (!cam.ready->push(frame)) {
+				cam.capture.requeue(frame);
+				cam.overflow++;
+				continue;
+			}
+			wake();
+		}
+	} catch (const std::system_error &e) {
+		error_ = e.code().value() ? e.code().value() : EIO;
+		running_ = false;
+		wake();
+	}
+}
+
+void StereoSync::wake()
+{
+	signalFd(event_fd_);
+}
+
+/* Back to the capture thread, which requeues it to the driver */
+void StereoSync::giveBack(Camera &cam, const Frame &frame)
+{
+	cam.done->push(frame);
+	signalFd(cam.wake_fd);
+}
+
+bool StereoSync::wait(int timeout_ms)
+{
+	struct pollfd pfd = { event_fd_, POLLIN, 0 };
+	uint64_t count;
+
+	if (poll(&pfd, 1, timeout_ms) <= 0)
+		return false;
+
+	return read(event_fd_, &count, sizeof(count)) == sizeof(count);
+}
+
+void StereoSync::drop(Camera &cam)
+{
+	Frame f = *cam.ready->front();
+
+	cam.ready->pop();
+	giveBack(cam, f);
+	cam.unmatched++;
+}
+
+bool StereoSync::next(StereoPair &pair, int timeout_ms)
+{
+	int64_t deadline = monotonicNs() + static_cast<int64_t>(timeout_ms) * 1000000;
+
+	for (;;) {
+		if (error_)
+			throw std::system_error(error_, std::generic_category(),
+						"capture thread");
+
+		Frame *l = cams_[0].ready ? cams_[0].ready->front() : nullptr;
+		Frame *r = cams_[1].ready ? cams_[1].ready->front() : nullptr;
+
+		if (!l || !r) {
+			int64_t left_ns = deadline - monotonicNs();
+
+			if (left_ns <= 0)
+				return false;
+			wait(static_cast<int>((left_ns + 999999) / 1000000));
+			continue;
+		}
+
+		bool matched;
+		bool drop_left;
+
+		if (match_ == Match::Sequence) {
+			for (int i = 0; i < 2; i++) {
+				Frame *f = i ? r : l;
+
+				if (!cams_[i].have_first) {
+					cams_[i].first_seq = f->sequence;
+					cams_[i].have_first = true;
+				}
+			}
+
+			uint32_t li = l->sequence - cams_[0].first_seq;
+			uint32_t ri = r->sequence - cams_[1].first_seq;
+
+			matched = li == ri;
+			drop_left = li < ri;
+		} else {
+			int64_t skew = r->timestamp_ns - l->timestamp_ns;
+
+			matched = skew >= -tolerance_ns_ && skew <= tolerance_ns_;
+			drop_left = skew > 0;
+		}
+
+		/* The older frame lost its partner, a newer one cannot match it */
+		if (!matched) {
+			drop(drop_left ? cams_[0] : cams_[1]);
+			continue;
+		}
+
+		pair.left = *l;
+		pair.right = *r;
+		pair.skew_ns = r->timestamp_ns - l->timestamp_ns;
+		pair.paired_ns = monotonicNs();
+		cams_[0].ready->pop();
+		cams_[1].ready->pop();
+		pairs_++;
+		return true;
+	}
+}
+
+void StereoSync::release(const StereoPair &pair)
+{
+	/* After stop() the buffers already went back with STREAMOFF */
+	if (!cams_[0].done || !cams_[1].done)
+		return;
+
+	giveBack(cams_[0], pair.left);
+	giveBack(cams_[1], pair.right);
+}
+
+StereoStats StereoSync::stats() const
+{
+	StereoStats s;
+
+	s.pairs = pairs_;
+	s.unmatched_left = cams_[0].unmatched;
+	s.unmatched_right = cams_[1].unmatched;
+	s.overflow_left = cams_[0].overflow;
+	s.overflow_right = cams_[1].overflow;
+	return s;
+}
+
+} /* namespace ov7251 */
@@ -0,0 +1,103 @@
+/*
+ * Stereo frame pairing for two triggered InnoMaker MIPI OV7251 cameras
+ *
+ * Copyright (C) 2022 SHENZHEN InnoMaker
+ *
+ * Each camera is captured on its own thread. Dequeued buffers travel to
+ * the pairing side through a lock-free SPSC queue and come back through
+ * a second one, so each video node is only touched by its own thread and
+ * frames are never copied: a StereoPair carries the mapped buffers and
+ * their DMABUF fds until release() is called. Capture threads sleep in
+ * poll() on the video node and a per-camera eventfd, which release()
+ * and stop() signal, so returned buffers are requeued at once without
+ * any timeout polling.
+ */
+
+#ifndef OV7251_TOOLS_STEREO_SYNC_H
+#define OV7251_TOOLS_STEREO_SYNC_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../common/spsc_queue.h"
+#include "../common/v4l2_capture.h"
+
+namespace ov7251 {
+
+struct StereoPair {
+	Frame left;
+	Frame right;
+	int64_t skew_ns = 0;		/* right - left buffer timestamp */
+	int64_t paired_ns = 0;		/* CLOCK_MONOTONIC when matched */
+};
+
+struct StereoStats {
+	uint64_t pairs = 0;
+	uint64_t unmatched_left = 0;	/* dropped, no partner in tolerance */
+	uint64_t unmatched_right = 0;
+	uint64_t overflow_left = 0;	/* requeued, pairing side too slow */
+	uint64_t overflow_right = 0;
+};
+
+class StereoSync {
+public:
+	enum class Match {
+		Timestamp,	/* buffer timestamps within tolerance */
+		Sequence,	/* same sequence offset from stream start */
+	};
+
+	StereoSync(const std::string &left, const std::string &right,
+		   unsigned int buffers, Match match, int64_t tolerance_ns);
+	~StereoSync();
+
+	StereoSync(const StereoSync &) = delete;
+	StereoSync &operator=(const StereoSync &) = delete;
+
+	V4l2Capture &leftCapture() { return cams_[0].capture; }
+	V4l2Capture &rightCapture() { return cams_[1].capture; }
+
+	void start();
+	void stop();
+
+	/* Wait up to timeout_ms for the next pair, false on timeout. */
+	bool next(StereoPair &pair, int timeout_ms);
+	/* Hand both buffers back to their capture threads. */
+	void release(const StereoPair &pair);
+
+	StereoStats stats() const;
+
+private:
+	struct Camera {
+		V4l2Capture capture;
+		std::unique_ptr<SpscQueue<Frame>> ready;
+		std::unique_ptr<SpscQueue<Frame>> done;
+		std::thread thread;
+		int wake_fd = -1;	/* buffers returned or stopping */
+		std::atomic<uint64_t> overflow{ 0 };
+		uint32_t first_seq = 0;
+		bool have_first = false;
+		uint64_t unmatched = 0;
+	};
+
+	void captureLoop(Camera &cam);
+	void drop(Camera &cam);
+	void giveBack(Camera &cam, const Frame &frame);
+	void wake();
+	bool wait(int timeout_ms);
+
+	Camera cams_[2];
+	Match match_;
+	int64_t tolerance_ns_;
+	unsigned int buffers_;
+	uint64_t pairs_ = 0;
+	int event_fd_ = -1;
+	std::atomic<bool> running_{ false };
+	std::atomic<int> error_{ 0 };
+};
+
+} /* namespace ov7251 */
+
+#endif /* OV7251_TOOLS_STEREO_SYNC_H */
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+#
+# ov7251_tuning_bench - compare PiSP tuning files for the InnoMaker MIPI
+# OV7251 through the full libcamera pipeline (ISP + IPA)
+#
+# Copyright (C) 2022 SHENZHEN InnoMaker
+#
+# For each tuning file the camera is started, AGC convergence is timed,
+# then frames are collected and reported:
+#
+#   fps          delivered frame rate
+#   latency      SensorTimestamp (start of frame, CLOCK_MONOTONIC) to the
+#                moment the request reaches the application, i.e. readout
+#                + ISP + IPA + delivery
+#   ipa cpu      process CPU time per frame, dominated by the IPA thread
+#   converge     frames until exposure x gain settles after start
+#
+# Run on the Pi with nothing else using the camera:
+#
+#   python3 ov7251_tuning_bench.py ov7251_mono.json ov7251_mono_lowlatency.json
+
+import argparse
+import statistics
+import time
+
+from picamera2 import Picamera2
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def run(args, tuning_file):
+    tuning = Picamera2.load_tuning_file(tuning_file)
+    picam2 = Picamera2(args.camera, tuning=tuning)
+    config = picam2.create_video_configuration(
+        main={"size": (args.width, args.height)},
+        controls={"FrameRate": args.fps},
+        buffer_count=6)
+    picam2.configure(config)
+    picam2.start()
+
+    converge = None
+    stable = 0
+    last_level = None
+    latency = []
+    arrivals = []
+    cpu_start = None
+
+    try:
+        for i in range(args.warmup + args.frames):
+            request = picam2.capture_request()
+            now = time.monotonic_ns()
+            md = request.get_metadata()
+            request.release()
+
+            level = md["ExposureTime"] * md["AnalogueGain"]
+            if converge is None:
+                if last_level and abs(level - last_level) <= 0.02 * last_level:
+                    stable += 1
+                    if stable == 3:
+                        converge = i - 2
+                else:
+                    stable = 0
+                last_level = level
+
+            if i < args.warmup:
+                continue
+            if cpu_start is None:
+                cpu_start = time.process_time()
+
+            latency.append((now - md["SensorTimestamp"]) / 1e6)
+            arrivals.append(now)
+    finally:
+        cpu = time.process_time() - cpu_start if cpu_start is not None else 0
+        picam2.stop()
+        picam2.close()
+
+    span = (arrivals[-1] - arrivals[0]) / 1e9
+    return {
+        "fps": (len(arrivals) - 1) / span if span > 0 else 0,
+        "lat_p50": percentile(latency, 50),
+        "lat_p99": percentile(latency, 99),
+        "lat_max": max(latency),
+        "lat_stdev": statistics.pstdev(latency),
+        "cpu_ms": cpu * 1e3 / len(arrivals),
+        "converge": converge,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Compare OV7251 PiSP tuning files")
+    parser.add_argument("tuning", nargs="+", help="tuning files to compare")
+    parser.add_argument("-c", "--camera", type=int, default=0)
+    parser.add_argument("-n", "--frames", type=int, default=1200)
+    parser.add_argument("-w", "--warmup", type=int, default=60)
+    parser.add_argument("-W", "--width", type=int, default=640)
+    parser.add_argument("-H", "--height", type=int, default=480)
+    parser.add_argument("-f", "--fps", type=float, default=120.0)
+    args = parser.parse_args()
+
+    print("%-36s %8s %9s %9s %9s %8s %8s %9s" %
+          ("tuning file", "fps", "lat p50", "lat p99", "lat max",
+           "stdev", "cpu/frm", "converge"))
+    for tuning_file in args.tuning:
+        r = run(args, tuning_file)
+        print("%-36s %8.2f %7.2fms %7.2fms %7.2fms %6.2fms %6.3fms %9s" %
+              (tuning_file, r["fps"], r["lat_p50"], r["lat_p99"],
+               r["lat_max"], r["lat_stdev"], r["cpu_ms"],
+               r["converge"] if r["converge"] is not None else "n/a"))
+
+
+if __name__ == "__main__":
+    main()